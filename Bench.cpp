@@ -0,0 +1,271 @@
+#include "Bench.h"
+#include "PerftPool.h"
+
+/*
+ * Run a benchmark on its own thread, so it
+ * searches its own position stack and leaves the game alone
+ * @param name the benchmark to run
+ */
+void Bench::run(std::string name) {
+    void (*bench)() = nullptr;
+    if (name == "stack")
+        bench = stack;
+    else if (name == "make")
+        bench = make;
+    else if (name == "sliders")
+        bench = sliders;
+    else if (name == "bits")
+        bench = bits;
+    else if (name == "tt")
+        bench = tt;
+    else if (name == "search")
+        bench = search;
+    if (!bench) {
+        fmt::print("Unknown benchmark {}. Try one of: stack make sliders bits tt search\n", name);
+        return;
+    }
+    std::thread(bench).join();
+}
+
+/*
+ * Time copy-make: push_move and unmake_move every legal move,
+ * then a short perft for the cost inside a full tree walk
+ */
+void Bench::stack() {
+    const int ITERATIONS = 200000;
+    for (const std::string& fen : POSITIONS) {
+        Chess::stack.reset(Chess(fen));
+        MoveGenerator bench_gen(Chess::state());
+        MoveList moves;
+        bench_gen.gen_moves(moves);
+
+        U64 cycles = 0;
+        Timer bench_timer;
+        for (int i = 0; i < ITERATIONS; i++)
+            for (int mvidx = 0; mvidx < moves.size(); mvidx++) {
+                Chess::push_move(moves[mvidx]);
+                Chess::unmake_move(1);
+                cycles++;
+            }
+        double push_pop = bench_timer.elapsed();
+
+        U64 nodes = 0;
+        bench_timer.reset();
+        PerftPool::perft(4, nodes);
+        double perft = bench_timer.elapsed();
+        fmt::print("{:>7.2f} ns per push/pop {:>12.0f} perft nodes/s  {}\n",
+            push_pop * 1e9 / cycles, nodes / perft, fen);
+    }
+}
+
+/*
+ * Compare perft nodes/s of copy-make against in-place make/unmake
+ */
+void Bench::make() {
+    const int DEPTH = 4;
+    for (const std::string& fen : POSITIONS) {
+        Chess::stack.reset(Chess(fen));
+        U64 copy_nodes = 0;
+        Timer bench_timer;
+        copy_perft(DEPTH, copy_nodes);
+        double copy_make = bench_timer.elapsed();
+
+        U64 nodes = 0;
+        bench_timer.reset();
+        PerftPool::perft(DEPTH, nodes);
+        double in_place = bench_timer.elapsed();
+        fmt::print("copy {:>10.0f} in place {:>10.0f} nodes/s ({:+.1f}%)  {}\n",
+            copy_nodes / copy_make, nodes / in_place, 100 * (copy_make / in_place - 1), fen);
+    }
+}
+
+/*
+ * PerftPool::perft through push_move and unmake_move
+ * @param depth number of ply remaining
+ * @param nodes U64& to count the number of positions searched
+ */
+U64 Bench::copy_perft(int depth, U64& nodes) {
+    if (!depth)
+        return 1;
+    U64 leaf_nodes = 0;
+    MoveGenerator perft_gen(Chess::state());
+    if (depth == 1) {
+        leaf_nodes = perft_gen.count_moves();
+        nodes += leaf_nodes;
+        return leaf_nodes;
+    }
+    MoveList moves;
+    perft_gen.gen_moves(moves);
+    for (int mvidx = 0; mvidx < moves.size(); mvidx++) {
+        Chess::push_move(moves[mvidx]);
+        nodes++;
+        leaf_nodes += copy_perft(depth - 1, nodes);
+        Chess::unmake_move(1);
+    }
+    return leaf_nodes;
+}
+
+/*
+ * Compare Kogge-Stone fill slider attacks against the lookup tables
+ */
+void Bench::sliders() {
+    const int LOOKUPS = 1 << 24;
+    std::mt19937_64 rng(1);
+    std::vector<U64> occs(4096);
+    for (U64& occ : occs)
+        occ = rng() & rng();
+
+    int mismatches = 0;
+    for (int i = 0; i < 64 * (int) occs.size(); i++)
+        mismatches += Compass::rook_attacks(occs[i >> 6], i & 63) != Compass::rook_fill(occs[i >> 6], i & 63)
+                   || Compass::bishop_attacks(occs[i >> 6], i & 63) != Compass::bishop_fill(occs[i >> 6], i & 63);
+
+    U64 fill_sum = 0;
+    Timer bench_timer;
+    for (int i = 0; i < LOOKUPS; i++)
+        fill_sum ^= Compass::rook_fill(occs[(i >> 6) & 4095], i & 63)
+                  ^ Compass::bishop_fill(occs[(i >> 6) & 4095], i & 63);
+    double fill = bench_timer.elapsed();
+
+    U64 lookup_sum = 0;
+    bench_timer.reset();
+    for (int i = 0; i < LOOKUPS; i++)
+        lookup_sum ^= Compass::rook_attacks(occs[(i >> 6) & 4095], i & 63)
+                    ^ Compass::bishop_attacks(occs[(i >> 6) & 4095], i & 63);
+    double lookup = bench_timer.elapsed();
+
+#ifdef USE_PEXT
+    const char* index = "pext";
+#else
+    const char* index = "magic";
+#endif
+    fmt::print("fill {:.2f} ns, {} {:.2f} ns per rook and bishop attack set, {} mismatches{}\n",
+        fill * 1e9 / LOOKUPS, index, lookup * 1e9 / LOOKUPS, mismatches, fill_sum == lookup_sum ? "" : "!");
+}
+
+/*
+ * Time the bit operations this build compiles to against the portable
+ * versions, then count how many of them a perft node makes and
+ * what that costs per node
+ */
+void Bench::bits() {
+    const int OPS = 1 << 24;
+    std::mt19937_64 rng(1);
+    std::vector<U64> bbs(4096);
+    for (U64& bb : bbs)
+        bb = rng() & rng() | 1ull << (rng() & 63);
+
+    int sum = 0;
+    Timer bench_timer;
+    for (int i = 0; i < OPS; i++)
+        sum += BB::count_bits(bbs[i & 4095]);
+    double count_fast = bench_timer.elapsed();
+    bench_timer.reset();
+    for (int i = 0; i < OPS; i++)
+        sum -= BB::portable_count_bits(bbs[i & 4095]);
+    double count_slow = bench_timer.elapsed();
+
+    bench_timer.reset();
+    for (int i = 0; i < OPS; i++)
+        sum += BB::lsb(bbs[i & 4095]);
+    double lsb_fast = bench_timer.elapsed();
+    bench_timer.reset();
+    for (int i = 0; i < OPS; i++)
+        sum -= BB::portable_lsb(bbs[i & 4095]);
+    double lsb_slow = bench_timer.elapsed();
+
+    fmt::print("bit instructions: {}{}\n", BB::bit_instructions(), sum ? " mismatch!" : "");
+    fmt::print("count_bits {:.2f} ns, portable {:.2f} ns\n", count_fast * 1e9 / OPS, count_slow * 1e9 / OPS);
+    fmt::print("lsb        {:.2f} ns, portable {:.2f} ns\n", lsb_fast * 1e9 / OPS, lsb_slow * 1e9 / OPS);
+
+    // per node cost inside a real tree walk
+    for (const std::string& fen : POSITIONS) {
+        Chess::stack.reset(Chess(fen));
+        U64 nodes = 0;
+        bench_timer.reset();
+        PerftPool::perft(4, nodes);
+        double perft = bench_timer.elapsed();
+        fmt::print("{:>7.2f} ns per perft node  {}\n", perft * 1e9 / nodes, fen);
+    }
+}
+
+/*
+ * Stress the shared table: every core stores and probes keys that all
+ * land in 16 buckets, so writes to the same entries race constantly.
+ * probe() hands back the probe key itself, so mismatches are found
+ * through the depth, score, best move and flag, which are all derived
+ * from the key: a torn or mixed up entry returned as valid breaks them.
+ */
+void Bench::tt() {
+    const int OPS = 1 << 22;
+    const int KEYS = 128;
+    int threads = std::max(4u, std::thread::hardware_concurrency());
+    size_t table_mb = TTable::size_mb();
+    TTable::resize(1);
+
+    std::vector<U64> keys(KEYS);
+    std::mt19937_64 rng(1);
+    // distinct tags in the top 16 bits, a random middle, one of 16 buckets
+    for (int k = 0; k < KEYS; k++)
+        keys[k] = (U64) k << 48 | (rng() & 0x0000fffffff00000ull) | (rng() & 15);
+
+    std::atomic<U64> probes{0}, found{0}, torn{0};
+    Timer bench_timer;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&, t]() {
+            std::mt19937_64 thread_rng(t + 1);
+            U64 thread_probes = 0, thread_found = 0, thread_torn = 0;
+            for (int i = 0; i < OPS; i++) {
+                U64 key = keys[thread_rng() % KEYS];
+                int8_t depth = key >> 20 & 63;
+                float score = (float) ((int) (key >> 26 & 0x3fff) - 8192) / 100;
+                move best = (move) (key >> 32);
+                uint8_t flag = 1 + key % 3;
+                if (i & 1) {
+                    TTable::add_item(key, depth, flag, score, best);
+                    continue;
+                }
+                thread_probes++;
+                Entry e = TTable::probe(key);
+                if (!e.flag)
+                    continue;
+                thread_found++;
+                thread_torn += e.depth != depth || e.score != score || e.best != best || e.flag != flag;
+            }
+            probes += thread_probes;
+            found += thread_found;
+            torn += thread_torn;
+        });
+    for (std::thread& worker : workers)
+        worker.join();
+    double elapsed = bench_timer.elapsed();
+
+    TTStats stats = TTable::total_stats();
+    fmt::print("{} threads, {} probes, {} found, {} torn entries returned{}\n",
+        threads, probes.load(), found.load(), torn.load(), torn ? "!" : "");
+    fmt::print("{} writes, {} collisions counted across threads, {:.1f} ns per operation per thread\n",
+        stats.writes, stats.collisions, elapsed * 1e9 / OPS);
+    TTable::resize((int) table_mb);
+}
+
+/*
+ * Time a fixed depth search of each position
+ */
+void Bench::search() {
+    const int DEPTH = 2;
+    Player bench_player(1.0f);
+    U64 total_nodes = 0;
+    Timer total_timer;
+    for (const std::string& fen : POSITIONS) {
+        Chess::stack.reset(Chess(fen));
+        U64 nodes = 0;
+        Timer bench_timer;
+        move best = bench_player.iterative_search(DEPTH, nodes, false);
+        double elapsed = bench_timer.elapsed();
+        total_nodes += nodes;
+        fmt::print("{:<6} {:>10} nodes {:>7.3f}s {:>10.0f} nodes/s  {}\n",
+            MoveGenerator::move_san(best), nodes, elapsed, nodes / elapsed, fen);
+    }
+    fmt::print("{} nodes at {:.0f} nodes/s\n", total_nodes, total_nodes / total_timer.elapsed());
+}
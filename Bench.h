@@ -0,0 +1,31 @@
+// Benchmarks for the hot paths of move generation and search
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <random>
+#include <thread>
+#include "Timer.h"
+#include "Player.h"
+
+namespace Bench
+{
+    const std::string POSITIONS[] = {
+        ch_cst::START_FEN,
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+        "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10"
+    };
+    void run(std::string name);
+    void stack();
+    void make();
+    void sliders();
+    void bits();
+    void tt();
+    U64 copy_perft(int depth, U64& nodes);
+    void search();
+}
+
+#endif
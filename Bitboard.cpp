@@ -11,18 +11,61 @@ bool BB::contains_square(U64 bb, int sq) {
 }
 
 /*
- * Method to count the number of true bits in a bitboard
- * @param bb any bitboard
- * @return the number of bits set in bb
+ * @return the bit instructions this build compiles to
  */
-int BB::count_bits(U64 bb) {
-    int count = 0;
-    while (bb) {
-        count++;
-        // clear the LS1B
-        bb &= bb - 1;
-    }
-    return count;
+std::string BB::bit_instructions() {
+#if defined(__POPCNT__) || defined(_MSC_VER) && defined(USE_BMI)
+    std::string ops = "popcnt";
+#else
+    std::string ops = "portable popcount";
+#endif
+#if defined(__BMI__) || defined(_MSC_VER) && defined(USE_BMI)
+    ops += " tzcnt blsr";
+#else
+    ops += " bsf";
+#endif
+#if defined(USE_PEXT)
+    ops += " pext";
+#endif
+    return ops;
+}
+
+/*
+ * Method to check the CPU for the instructions this build was compiled with
+ * @return the missing instruction sets, empty if the build can run here
+ */
+std::string BB::missing_cpu_features() {
+    std::string missing = "";
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+#if defined(__POPCNT__)
+    if (!__builtin_cpu_supports("popcnt"))
+        missing += "POPCNT ";
+#endif
+#if defined(__BMI__)
+    if (!__builtin_cpu_supports("bmi"))
+        missing += "BMI1 ";
+#endif
+#if defined(__BMI2__) || defined(USE_PEXT)
+    if (!__builtin_cpu_supports("bmi2"))
+        missing += "BMI2 ";
+#endif
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int leaf1[4], leaf7[4];
+    __cpuid(leaf1, 1);
+    __cpuidex(leaf7, 7, 0);
+#if defined(USE_BMI)
+    if (!(leaf1[2] & 1 << 23))
+        missing += "POPCNT ";
+    if (!(leaf7[1] & 1 << 3))
+        missing += "BMI1 ";
+#endif
+#if defined(USE_PEXT)
+    if (!(leaf7[1] & 1 << 8))
+        missing += "BMI2 ";
+#endif
+#endif
+    return missing;
 }
 
 /*
@@ -289,7 +332,11 @@ std::string BB::build_binary_string(U64 bb) {
  * @return bitboard x flipped vertically
  */
 U64 BB::flip_vertical(U64 bb) {
+#if defined(__GNUC__)
+   return __builtin_bswap64(bb);
+#else
    return _byteswap_uint64(bb);
+#endif
 }
 
 /*
@@ -313,11 +360,11 @@ void BB::print_binary_string(std::string bbstr, bool fmt) {
 }
 
 /*
- * method to count the number of leading zeros in a bitboard
+ * Portable leading zero count
  * @param any bitboard
  * @return the number of leading zeros
  */
-int BB::lz_count(U64 bb) {
+int BB::portable_lz_count(U64 bb) {
     if (!bb) return 64;
     int count = 0;
     // is the msb in the top 32 bits?
@@ -3,7 +3,10 @@
 
 #include <string>
 #include <iostream>
+#include <cstdint>
+#ifdef _MSC_VER
 #include <intrin.h>
+#endif
 
 #define U64 uint64_t
 
@@ -39,11 +42,102 @@ namespace BB {
     U64 gen_shift(U64 bb, int s);
     U64 flip_vertical(U64 bb);
     bool contains_square(U64 bb, int sq);
-    int count_bits(U64 bb);
     void print_U64(U64 bb, std::string name = "", bool fmt = false);
     void print_binary_string(std::string bbstr, bool fmt = false);
     std::string build_binary_string(U64 bb);
-    int lz_count(U64 bb);
+    int portable_lz_count(U64 bb);
+    std::string bit_instructions();
+    std::string missing_cpu_features();
+
+    /*
+     * Bit twiddling on the hot paths compiles to single instructions where
+     * the build allows: POPCNT, TZCNT and BLSR with USE_BMI or -march flags
+     * on GCC and Clang, the matching intrinsics on MSVC.
+     * Other builds fall back to BSF/BSR and a portable popcount,
+     * which beats the library call GCC makes without POPCNT.
+     * missing_cpu_features() checks the CPU at startup against the build.
+     */
+
+    /*
+     * Portable popcount, adding up bit counts in ever wider fields
+     * @param bb any bitboard
+     * @return the number of bits set in bb
+     */
+    inline int portable_count_bits(U64 bb) {
+        bb = bb - ((bb >> 1) & 0x5555555555555555);
+        bb = (bb & 0x3333333333333333) + ((bb >> 2) & 0x3333333333333333);
+        bb = (bb + (bb >> 4)) & 0x0f0f0f0f0f0f0f0f;
+        return (int) ((bb * 0x0101010101010101) >> 56);
+    }
+
+    /*
+     * Portable bitscan forward with a De Bruijn multiply
+     * @param bb any nonzero bitboard
+     * @return the square index of the least significant set bit
+     */
+    inline int portable_lsb(U64 bb) {
+        static const int index64[64] = {
+             0,  1, 48,  2, 57, 49, 28,  3,
+            61, 58, 50, 42, 38, 29, 17,  4,
+            62, 55, 59, 36, 53, 51, 43, 22,
+            45, 39, 33, 30, 24, 18, 12,  5,
+            63, 47, 56, 27, 60, 41, 37, 16,
+            54, 35, 52, 21, 44, 32, 23, 11,
+            46, 26, 40, 15, 34, 20, 31, 10,
+            25, 14, 19,  9, 13,  8,  7,  6
+        };
+        // x & -x masks the LS1B
+        return index64[((bb & 0-bb) * 0x03f79d71b4cb0a89) >> 58];
+    }
+
+    /*
+     * Method to count the number of true bits in a bitboard
+     * @param bb any bitboard
+     * @return the number of bits set in bb
+     */
+    inline int count_bits(U64 bb) {
+#if defined(__GNUC__) && defined(__POPCNT__)
+        return __builtin_popcountll(bb);
+#elif defined(_MSC_VER) && defined(USE_BMI)
+        return (int) __popcnt64(bb);
+#else
+        return portable_count_bits(bb);
+#endif
+    }
+
+    /*
+     * @param bb any nonzero bitboard
+     * @return the square index of the least significant set bit
+     */
+    inline int lsb(U64 bb) {
+#if defined(__GNUC__)
+        return __builtin_ctzll(bb);
+#elif defined(_MSC_VER) && defined(USE_BMI)
+        return (int) _tzcnt_u64(bb);
+#elif defined(_MSC_VER)
+        unsigned long sq;
+        _BitScanForward64(&sq, bb);
+        return (int) sq;
+#else
+        return portable_lsb(bb);
+#endif
+    }
+
+    /*
+     * method to count the number of leading zeros in a bitboard
+     * @param any bitboard
+     * @return the number of leading zeros
+     */
+    inline int lz_count(U64 bb) {
+#if defined(__GNUC__)
+        return bb ? __builtin_clzll(bb) : 64;
+#elif defined(_MSC_VER)
+        unsigned long sq;
+        return _BitScanReverse64(&sq, bb) ? 63 - (int) sq : 64;
+#else
+        return portable_lz_count(bb);
+#endif
+    }
 }
 
 #endif
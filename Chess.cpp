@@ -1,6 +1,7 @@
 #include "Chess.h"
+#include <algorithm>
 
-ch_stk::ChessStack<Chess> Chess::stack;
+thread_local ch_stk::ChessStack<Chess> Chess::stack;
 
 Chess::Chess() {
     this->black_to_move = false;
@@ -39,10 +40,12 @@ Chess::Chess(const std::string fen) {
                 // white pieces
                 this->bb_white         |= 1ull << sq;
                 *this->bb_piece[piece] |= 1ull << sq;
+                this->mailbox[sq]       = piece;
             } else if (fen[loc] == ch_cst::piece_char[piece + 8]) {
                 // black pieces
                 this->bb_black         |= 1ull << sq;
                 *this->bb_piece[piece] |= 1ull << sq;
+                this->mailbox[sq]       = piece;
             }
         }
         f = (f + 1) % 8;
@@ -168,6 +171,16 @@ std::string Chess::fen() const {
 
 // copy constructor without make_move
 Chess::Chess(const Chess& _ch) {
+    *this = _ch;
+}
+
+/*
+ * Copy assignment, used by the position stack for copy-make.
+ * bb_piece and bb_color keep pointing at this position's bitboards.
+ */
+Chess& Chess::operator=(const Chess& _ch) {
+    if (this == &_ch)
+        return *this;
     this->black_to_move = _ch.black_to_move;
     this->castle_rights = _ch.castle_rights;
     this->ep_square     = _ch.ep_square;
@@ -184,6 +197,9 @@ Chess::Chess(const Chess& _ch) {
     this->bb_queens     = _ch.bb_queens;
     this->bb_kings      = _ch.bb_kings;
     this->bb_occ        = _ch.bb_occ;
+    std::copy(_ch.mailbox, _ch.mailbox + 64, this->mailbox);
+    this->attack_info   = _ch.attack_info;
+    return *this;
 }
 
 /*
@@ -199,6 +215,9 @@ void Chess::build_bitboards() {
     bb_queens  = 0b00001000ull << 8 * 7 | 0b00001000ull;
     bb_kings   = 0b00010000ull << 8 * 7 | 0b00010000ull;
     bb_occ     = bb_white               | bb_black;
+    for (int sq = 0; sq < 64; sq++)
+        for (int piece = ch_cst::PAWN; piece <= ch_cst::KING; piece++)
+            mailbox[sq] = *bb_piece[piece] & 1ull << sq ? piece : mailbox[sq];
 }
 
 /*
@@ -213,8 +232,8 @@ U64 Chess::hash() const {
     U64 pieces = bb_occ;
 
     while (pieces) {
-        // x & -x masks the LS1B
-        int sq = 63 - BB::lz_count(pieces & 0-pieces);
+        // square of the LS1B
+        int sq = BB::lsb(pieces);
         h ^= TTable::sq_color_type_64x2x6[sq][black_at(sq)][piece_at(sq) - 1];
         // now clear that LS1B
         pieces &= pieces - 1;
@@ -232,26 +251,14 @@ U64 Chess::hash() const {
     return h;
 }
 
-/*
- * Method to return the piece type on a square, if any
- * @param sq the square index to check
- * @return the piece type (1 - 6) or 0 if no piece is found
- *         returns 0 if no piece is found
- */
-int Chess::piece_at(int sq) const {
-    for (int piece = ch_cst::PAWN; piece <= ch_cst::KING; piece++)
-        if (*bb_piece[piece] & 1ull << sq)
-            return piece;
-    return 0;
-}
-
 /*
  * Method to find a given king.
  * @param color the color index of the king to search for
- * @return the square index of the king (0-63)
+ * @return the square index of the king (0-63), -1 if there is none
  */
 int Chess::find_king(bool is_black) const {
-    return 63 - BB::lz_count(bb_kings & *bb_color[is_black]);
+    U64 king = bb_kings & *bb_color[is_black];
+    return king ? BB::lsb(king) : -1;
 }
 
 /*
@@ -264,42 +271,71 @@ bool Chess::black_at(int sq) const {
 }
 
 void Chess::push_move(const move mv, bool test) {
-    Chess* curr = state();
-    Chess* next = new Chess(*curr);
-    next->make_move(mv, test);
-    // update the game stack
-    stack.push(next);
+    // copy the position into the next slot of the game stack
+    stack.push_key(stack.top()->zhash);
+    stack.push()->make_move(mv, test);
 }
 
 void Chess::make_move(const move mv, bool test) {
+    if (black_to_move)
+        play<true>(mv, mailbox[Move::end(mv)], mailbox[Move::start(mv)]);
+    else
+        play<false>(mv, mailbox[Move::end(mv)], mailbox[Move::start(mv)]);
+}
+
+/*
+ * Make a move in place once its pieces are known
+ * @param mv the move to make
+ * @param captured the piece on the end square, 0 if empty
+ * @param moved the piece on the start square
+ */
+template<bool Black>
+void Chess::play(const move mv, int captured, int moved) {
+    typedef Side<Black> S;
+    U64& own = Black ? bb_black : bb_white;
+    U64& op = Black ? bb_white : bb_black;
+    attack_info.clear();
     halfmoves++;
     int start = Move::start(mv);
     int end = Move::end(mv);
 
     // Captured piece
-    int type = piece_at(end);
+    int type = captured;
     if (type) {
         // remove captured pieces
-        zhash ^= TTable::sq_color_type_64x2x6[end][!black_to_move][type - 1];
+        zhash ^= TTable::sq_color_type_64x2x6[end][!Black][type - 1];
         *bb_piece[type] &= ~(1ull << end);
-        *bb_color[!black_to_move] &= ~(1ull << end);
+        op &= ~(1ull << end);
 
         // reset the halfmove counter after a capture
         halfmoves = 0;
+
+        // a rook captured on its starting square can no longer castle
+        if (type == ch_cst::ROOK && end == Side<!Black>::QUEEN_ROOK
+                && castle_rights & Side<!Black>::QUEEN_CASTLE) {
+            zhash ^= TTable::castle_rights_wb_kq[!Black][1];
+            castle_rights &= ~Side<!Black>::QUEEN_CASTLE;
+        } else if (type == ch_cst::ROOK && end == Side<!Black>::KING_ROOK
+                && castle_rights & Side<!Black>::KING_CASTLE) {
+            zhash ^= TTable::castle_rights_wb_kq[!Black][0];
+            castle_rights &= ~Side<!Black>::KING_CASTLE;
+        }
     }
 
     // Moving piece
-    type = Chess::piece_at(start);
+    type = moved;
 
     // remove the moving piece
     *bb_piece[type] &= ~(1ull << start);
-    *bb_color[black_to_move] &= ~(1ull << start);
-    zhash ^= TTable::sq_color_type_64x2x6[start][black_to_move][type - 1];
+    own &= ~(1ull << start);
+    zhash ^= TTable::sq_color_type_64x2x6[start][Black][type - 1];
+    mailbox[start] = 0;
 
     // place the moving piece
     *bb_piece[Move::promote(mv) ? Move::promote(mv) : type] |= 1ull << end;
-    *bb_color[black_to_move] |= 1ull << end;
-    zhash ^= TTable::sq_color_type_64x2x6[end][black_to_move][(Move::promote(mv) ? Move::promote(mv) : type) - 1];
+    own |= 1ull << end;
+    zhash ^= TTable::sq_color_type_64x2x6[end][Black][(Move::promote(mv) ? Move::promote(mv) : type) - 1];
+    mailbox[end] = Move::promote(mv) ? Move::promote(mv) : type;
 
     // Handle en passant captures and update ep square
     zhash ^= (ep_square >= 0) ? TTable::ep_file[Compass::file_xindex(ep_square)] : 0;
@@ -308,69 +344,146 @@ void Chess::make_move(const move mv, bool test) {
         halfmoves = 0;
 
         // en passant capture
-        bb_pawns ^= end == ep_square ? 1ull << (end - directions::PAWN_DIR[black_to_move]) : 0;
-        *bb_color[!black_to_move] ^= end == ep_square ? 1ull << (end - directions::PAWN_DIR[black_to_move]) : 0;
-        zhash ^= end == ep_square ? TTable::sq_color_type_64x2x6[end - directions::PAWN_DIR[black_to_move]][!black_to_move][ch_cst::PAWN - 1] : 0;
+        bb_pawns ^= end == ep_square ? 1ull << (end - S::UP) : 0;
+        op ^= end == ep_square ? 1ull << (end - S::UP) : 0;
+        zhash ^= end == ep_square ? TTable::sq_color_type_64x2x6[end - S::UP][!Black][ch_cst::PAWN - 1] : 0;
+        if (end == ep_square)
+            mailbox[end - S::UP] = 0;
 
         // double advance; prepare new en passant square
-        ep_square = (start - end) % 16 == 0 ? start + directions::PAWN_DIR[black_to_move] : -1;
+        ep_square = (start - end) % 16 == 0 ? start + S::UP : -1;
         zhash ^= (start - end) % 16 == 0 ? TTable::ep_file[Compass::file_xindex(ep_square)] : 0;
     } else ep_square = -1; // not a pawn move; reset ep_square
 
     // castles, disable castle rights
     if (type == ch_cst::KING) {
         // handle castles
-        if (end - start == 2 && castle_rights & (1 << (2 * black_to_move))) {
+        if (end - start == 2 && castle_rights & S::KING_CASTLE) {
             // kingside castle
             *bb_piece[ch_cst::ROOK] &= ~(1ull << (start | 0b111));
             *bb_piece[ch_cst::ROOK] |= 1ull << (end - 1);
-            *bb_color[black_to_move] &= ~(1ull << (start | 0b111));
-            *bb_color[black_to_move] |= 1ull << (end - 1);
-            zhash ^= TTable::sq_color_type_64x2x6[start | 0b111][black_to_move][ch_cst::ROOK - 1];
-            zhash ^= TTable::sq_color_type_64x2x6[end - 1][black_to_move][ch_cst::ROOK - 1];
-        } else if (end - start == -2 && castle_rights & (2 << (2 * black_to_move))) {
+            own &= ~(1ull << (start | 0b111));
+            own |= 1ull << (end - 1);
+            zhash ^= TTable::sq_color_type_64x2x6[start | 0b111][Black][ch_cst::ROOK - 1];
+            zhash ^= TTable::sq_color_type_64x2x6[end - 1][Black][ch_cst::ROOK - 1];
+            mailbox[start | 0b111] = 0;
+            mailbox[end - 1] = ch_cst::ROOK;
+        } else if (end - start == -2 && castle_rights & S::QUEEN_CASTLE) {
             // queenside castle
             *bb_piece[ch_cst::ROOK] &= ~(1ull << (start & 0b111000));
             *bb_piece[ch_cst::ROOK] |= 1ull << (end + 1);
-            *bb_color[black_to_move] &= ~(1ull << (start & 0b111000));
-            *bb_color[black_to_move] |= 1ull << (end + 1);
-            zhash ^= TTable::sq_color_type_64x2x6[start & 0b111000][black_to_move][ch_cst::ROOK - 1];
-            zhash ^= TTable::sq_color_type_64x2x6[end + 1][black_to_move][ch_cst::ROOK - 1];
+            own &= ~(1ull << (start & 0b111000));
+            own |= 1ull << (end + 1);
+            zhash ^= TTable::sq_color_type_64x2x6[start & 0b111000][Black][ch_cst::ROOK - 1];
+            zhash ^= TTable::sq_color_type_64x2x6[end + 1][Black][ch_cst::ROOK - 1];
+            mailbox[start & 0b111000] = 0;
+            mailbox[end + 1] = ch_cst::ROOK;
         }
         // update castle rights
-        zhash ^= castle_rights & (1 << (2 * black_to_move)) ? TTable::castle_rights_wb_kq[black_to_move][0] : 0ull;
-        zhash ^= castle_rights & (2 << (2 * black_to_move)) ? TTable::castle_rights_wb_kq[black_to_move][1] : 0ull;
-        castle_rights &= ~(3 << (2 * black_to_move));
+        zhash ^= castle_rights & S::KING_CASTLE ? TTable::castle_rights_wb_kq[Black][0] : 0ull;
+        zhash ^= castle_rights & S::QUEEN_CASTLE ? TTable::castle_rights_wb_kq[Black][1] : 0ull;
+        castle_rights &= ~(S::KING_CASTLE | S::QUEEN_CASTLE);
     } else if (type == ch_cst::ROOK) {
-        if (castle_rights & (2 << 2 * black_to_move) && Compass::rank_yindex(start) == 0) {
+        if (castle_rights & S::QUEEN_CASTLE && start == S::QUEEN_ROOK) {
             // queenside rook moved
-            zhash ^= TTable::castle_rights_wb_kq[black_to_move][1];
-            castle_rights &= ~(2 << 2 * black_to_move);
-        } else if (castle_rights & (1 << 2 * black_to_move) && Compass::rank_yindex(start) == 7) {
+            zhash ^= TTable::castle_rights_wb_kq[Black][1];
+            castle_rights &= ~S::QUEEN_CASTLE;
+        } else if (castle_rights & S::KING_CASTLE && start == S::KING_ROOK) {
             // kingside rook moved
-            zhash ^= TTable::castle_rights_wb_kq[black_to_move][0];
-            castle_rights &= ~(1 << 2 * black_to_move);
+            zhash ^= TTable::castle_rights_wb_kq[Black][0];
+            castle_rights &= ~S::KING_CASTLE;
         }
     }
 
     bb_occ = bb_white | bb_black;
-    fullmoves += black_to_move;
-    black_to_move = !black_to_move;
+    fullmoves += Black;
+    black_to_move = !Black;
     zhash ^= TTable::is_black_turn;
 }
 
 void Chess::unmake_move(uint32_t undos) {
-    for (uint32_t i = 0; i < undos; i++)
+    for (uint32_t i = 0; i < undos; i++) {
         stack.pop();
+        stack.pop_key();
+    }
 }
 
-int Chess::repetitions() const {
-    int count = 0;
-    ch_stk::StackNode<Chess>* tmp = stack.top;
-    while (tmp->next) {
-        count += (zhash == tmp->pos->zhash);
-        tmp = tmp->next;
+/*
+ * Make a move in place, without pushing a new position
+ * @param mv the move to make
+ * @return the undo record to pass to undo_move
+ */
+Undo Chess::do_move(const move mv) {
+    Undo undo = { mailbox[Move::end(mv)], mailbox[Move::start(mv)],
+        castle_rights, ep_square, halfmoves, zhash };
+    stack.push_key(zhash);
+    if (black_to_move)
+        play<true>(mv, undo.captured, undo.moved);
+    else
+        play<false>(mv, undo.captured, undo.moved);
+    return undo;
+}
+
+/*
+ * Take back a move made by do_move
+ * @param mv the move to take back
+ * @param undo the record do_move returned
+ */
+void Chess::undo_move(const move mv, const Undo& undo) {
+    attack_info.clear();
+    black_to_move = !black_to_move;
+    fullmoves -= black_to_move;
+    int start = Move::start(mv);
+    int end = Move::end(mv);
+    int type = undo.moved;
+
+    // move the piece back, demoting promotions
+    *bb_piece[Move::promote(mv) ? Move::promote(mv) : type] &= ~(1ull << end);
+    *bb_piece[type] |= 1ull << start;
+    *bb_color[black_to_move] ^= 1ull << end | 1ull << start;
+    mailbox[start] = type;
+    mailbox[end] = undo.captured;
+
+    // restore captured pieces
+    if (undo.captured) {
+        *bb_piece[undo.captured] |= 1ull << end;
+        *bb_color[!black_to_move] |= 1ull << end;
+    } else if (type == ch_cst::PAWN && end == undo.ep_square) {
+        bb_pawns |= 1ull << (end - directions::PAWN_DIR[black_to_move]);
+        *bb_color[!black_to_move] |= 1ull << (end - directions::PAWN_DIR[black_to_move]);
+        mailbox[end - directions::PAWN_DIR[black_to_move]] = ch_cst::PAWN;
     }
+
+    // put a castled rook back in its corner
+    if (type == ch_cst::KING && (end - start == 2 || end - start == -2)) {
+        int rook_start = end - start == 2 ? start | 0b111 : start & 0b111000;
+        int rook_end = end - start == 2 ? end - 1 : end + 1;
+        *bb_piece[ch_cst::ROOK] ^= 1ull << rook_start | 1ull << rook_end;
+        *bb_color[black_to_move] ^= 1ull << rook_start | 1ull << rook_end;
+        mailbox[rook_start] = ch_cst::ROOK;
+        mailbox[rook_end] = 0;
+    }
+
+    bb_occ = bb_white | bb_black;
+    castle_rights = undo.castle_rights;
+    ep_square = undo.ep_square;
+    halfmoves = undo.halfmoves;
+    zhash = undo.zhash;
+    stack.pop_key();
+}
+
+/*
+ * Count how many times the current position has occured.
+ * Only positions since the last capture or pawn move can repeat,
+ * and only those with the same side to move, every other ply.
+ * @return the number of occurences, including this one
+ */
+int Chess::repetitions() const {
+    int count = 1;
+    int oldest = stack.key_count - (int) halfmoves;
+    oldest = oldest > 0 ? oldest : 0;
+    for (int idx = stack.key_count - 2; idx >= oldest; idx -= 2)
+        count += (zhash == stack.keys[idx]);
     return count;
 }
 
@@ -14,15 +14,50 @@ namespace ch_cst {
     const std::string START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 }
 
+/*
+ * State an in-place make_move cannot recover from the move alone
+ */
+struct Undo {
+    int captured;
+    int moved;
+    int castle_rights;
+    int ep_square;
+    unsigned int halfmoves;
+    U64 zhash;
+};
+
+/*
+ * What the pieces of a position attack, filled by the move generator
+ * the first time a position is asked about and kept until it changes
+ */
+struct AttackInfo {
+    // the opponents' attacks, checks and pins are filled in
+    bool valid = false;
+    // the side to move's attacks are filled in too
+    bool both_sides = false;
+    // squares each color attacks, indexed like bb_color
+    // the side to move's king doesn't block the other side's attacks
+    U64 attacks[2];
+    U64 checkers;
+    // squares that block or capture a single checker
+    U64 check_ray;
+    U64 pinned;
+    bool in_check;
+    bool in_double_check;
+    inline void clear() { valid = both_sides = false; }
+};
+
 class Chess {
 public:
     Chess();
     Chess(const Chess& ch);
+    Chess& operator=(const Chess& ch);
     Chess(std::string fen);
 
     // Stack to store previous gamestates
-    static ch_stk::ChessStack<Chess> stack;
-    static inline Chess* state() { return stack.top->pos; }
+    // each thread searches its own stack of positions
+    static thread_local ch_stk::ChessStack<Chess> stack;
+    static inline Chess* state() { return stack.top(); }
 
     // bl:QuKi wh:QuKi
     int castle_rights;
@@ -41,11 +76,16 @@ public:
     U64 bb_occ{0};
     U64* bb_piece[7] = { nullptr, &bb_pawns, &bb_knights, &bb_bishops, &bb_rooks, &bb_queens, &bb_kings };
     U64* bb_color[2] = { &bb_white, &bb_black };
+    // piece type on each square, 0 if empty
+    uint8_t mailbox[64] = {};
     U64 zhash;
+    // cached attack maps, reset whenever a move is made or taken back
+    AttackInfo attack_info;
 
     std::string fen() const;
     int find_king(bool is_black) const;
-    int piece_at(int sq) const;
+    // piece type (1 - 6) on a square, 0 if empty
+    inline int piece_at(int sq) const { return mailbox[sq]; }
     bool black_at(int sq) const;
     U64 hash() const;
     void print_board(bool fmt = false) const;
@@ -55,8 +95,12 @@ public:
     static void push_move(const move mv, bool test = false);
     void make_move(move mv, bool test = false);
     static void unmake_move(uint32_t undos);
+    Undo do_move(move mv);
+    void undo_move(move mv, const Undo& undo);
 private:
     void build_bitboards();
+    // the side to move is known at compile time
+    template<bool Black> void play(move mv, int captured, int moved);
 };
 
 #endif
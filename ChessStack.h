@@ -1,38 +1,55 @@
 #ifndef CHESS_STACK_H
 #define CHESS_STACK_H
 
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
 namespace ch_stk
 {
-    template <class T>
-    struct StackNode {
-        StackNode* next;
-        T* pos;
-
-        StackNode() : next(nullptr), pos(nullptr) {};
-        StackNode(T* ch) : next(nullptr), pos(ch) {};
-        inline ~StackNode() {
-            delete next;
-            delete pos;
-        };
-    };
+    // most positions a game and its search can hold
+    const int MAX_PLY = 4096;
 
-    template <class T>
+    /*
+     * Fixed-capacity stack of positions indexed by ply.
+     * Storage is allocated once, push copies the top position
+     * into the next slot so copy-make never allocates.
+     * Alongside it, a flat history of the Zobrist keys of every
+     * position before the current one, for repetition detection.
+     * Moves made in place push keys without pushing positions.
+     */
+    template <class T, int N = MAX_PLY>
     struct ChessStack {
-        ChessStack() : top(new StackNode<T>()) {};
-        StackNode<T>* top;
+        ChessStack() : positions(N), ply(0), keys(N), key_count(0) {};
+        std::vector<T> positions;
+        int ply;
+        std::vector<uint64_t> keys;
+        int key_count;
 
-        inline bool is_empty() { return top == nullptr; };
-        inline void push(T* val) {
-            StackNode<T>* node = new StackNode<T>(val);
-            node->next = top;
-            top = node;
+        inline T* top() { return &positions[ply]; };
+        inline T* at(int i) { return &positions[i]; };
+        inline bool is_empty() const { return ply == 0; };
+        // pushing past N plies is a bug in the caller, not a position to drop
+        inline T* push() {
+            assert(ply + 1 < N);
+            positions[ply + 1] = positions[ply];
+            return &positions[++ply];
         };
         inline void pop() {
-            if (is_empty() || top->next == nullptr) return;
-            StackNode<T>* tmp = top;
-            top = top->next;
-            tmp->next = nullptr;
-            delete tmp;
+            if (ply > 0) ply--;
+        };
+        inline void push_key(uint64_t key) {
+            assert(key_count < N);
+            keys[key_count++] = key;
+        };
+        inline void pop_key() {
+            if (key_count > 0) key_count--;
+        };
+        // start a new game from pos
+        inline void reset(const T& pos) {
+            positions[0] = pos;
+            ply = 0;
+            key_count = 0;
         };
     };
 } // namespace ch_stk
@@ -1,16 +1,57 @@
 #include "Compass.h"
 
-U64 Compass::knight_attacks[64];
-U64 Compass::king_attacks[64];
-uint8_t Compass::first_rank_attacks_64x8[64*8];
-uint8_t Compass::edge_distance_64x8[64][8];
+Magic Compass::rook_magics[64];
+Magic Compass::bishop_magics[64];
+U64 Compass::slider_attacks[102400 + 5248];
+U64 Compass::between[64][64];
+U64 Compass::line[64][64];
 
+// multipliers that hash every blocker set of a square
+// to a unique index, found by random trial
+static const U64 ROOK_MAGIC_NUMBERS[64] = {
+    0x2080102040008000ull, 0x824000100040200aull, 0xb4800b2000801000ull, 0x050010005500a009ull,
+    0x2980040008000280ull, 0x0100020100040008ull, 0x8400014882101804ull, 0x0200004401002082ull,
+    0x8000800020804013ull, 0x0881002100804010ull, 0x0400808010002000ull, 0x44510010000d0021ull,
+    0x0002800400880180ull, 0x1140808002000400ull, 0x6401010200040100ull, 0x8020800080004100ull,
+    0x1000288008400483ull, 0x0010888040002004ull, 0x8470002000240800ull, 0x8108008010000881ull,
+    0x1120808008000400ull, 0x0080880104204010ull, 0x0000040001081002ull, 0x042202000840a104ull,
+    0x04c0008080004022ull, 0x1200400480200080ull, 0x0060100280200181ull, 0x00001042000a0020ull,
+    0x0004110100040800ull, 0x2009000300040008ull, 0x4400080400020110ull, 0x8000088200104104ull,
+    0x0481804001800020ull, 0x0490004008402008ull, 0x8520802000801001ull, 0x0000080082805000ull,
+    0x8010800400800800ull, 0x102a000400808002ull, 0x1200821004000108ull, 0x0608008c1a000041ull,
+    0x8040084028818000ull, 0x2310004020034004ull, 0xc510002000410100ull, 0x0000100008008080ull,
+    0x0840050008010010ull, 0x00a2001020040400ull, 0x1203100102040008ull, 0x0801002480450002ull,
+    0x9040004020800180ull, 0x4201004200208200ull, 0x9000402204108200ull, 0x0000080080100080ull,
+    0x0000800800040080ull, 0x0808800400020080ull, 0x0220100201080400ull, 0x0022406104009a00ull,
+    0x0888104220800101ull, 0x042040001081002dull, 0x0000100c20004101ull, 0x0091003520185001ull,
+    0x0112000810200402ull, 0x0211000400480a93ull, 0xc0840a4088300104ull, 0x0a07000042002081ull
+};
+static const U64 BISHOP_MAGIC_NUMBERS[64] = {
+    0x00a5080802440044ull, 0x4010040084004840ull, 0x8010840a81200040ull, 0x14420a0200001041ull,
+    0x0001104160020200ull, 0x8080882008600446ull, 0x0826022920080410ull, 0x0000404610016004ull,
+    0x2031040408280100ull, 0x0008020404041040ull, 0x03004800c4048c10ull, 0x0082044100204000ull,
+    0x0080211040810000ull, 0x0088110402400000ull, 0x0201010401200801ull, 0x0008148409011150ull,
+    0x00c0081091024080ull, 0x00200c48a1040888ull, 0x01080040504102a0ull, 0x3008080082810029ull,
+    0x0021000820081000ull, 0x0001000200412488ull, 0x10041100440404c0ull, 0x0100404084008821ull,
+    0x0042200a0a200400ull, 0x0008044222504227ull, 0x2402010008004400ull, 0x0020080011004008ull,
+    0x000c082004002000ull, 0x0004010002492000ull, 0x0584004281011060ull, 0x0a41010082541080ull,
+    0x1090886014840c40ull, 0x0240882834949020ull, 0x0080141000020080ull, 0x00a2010040040040ull,
+    0x00020084014a0020ull, 0x80082200211c1000ull, 0x08101a0201004120ull, 0x0611004480020204ull,
+    0x4124242004280804ull, 0x080964c820510900ull, 0x0108202030004800ull, 0x0200012011008800ull,
+    0x4850202020808410ull, 0x0020040082000021ull, 0x00602102120000a4ull, 0x001410a402409310ull,
+    0x00024c02094000a0ull, 0x0002410411a00004ull, 0x8080104644300000ull, 0x0084000084042000ull,
+    0x0304004085010420ull, 0xa600224410008009ull, 0x03084811480a0000ull, 0x00100240c1020000ull,
+    0x0040840088010800ull, 0x0010024304b01042ull, 0x0006008602022e02ull, 0x4014004000840410ull,
+    0x510600a040082201ull, 0x0000206022040840ull, 0x2091092104240040ull, 0x01401410b4810500ull
+};
+
+/*
+ * Fill the slider and line tables, the fixed
+ * geometry tables are built at compile time
+ */
 Compass::Compass() {
-    // init stuff
-    compute_edge_distances();
-    compute_knight_attacks();
-    compute_rank_attacks();
-    compute_king_attacks();
+    compute_slider_attacks();
+    compute_lines();
 }
 
 // Method to return a bitboard of the ray which
@@ -74,76 +115,73 @@ const U64 Compass::ray_square(int start, int end, U64 occ) {
     return 0ull;
 }
 
-void Compass::compute_edge_distances() {
-    for (int sq = 0; sq < 64; sq++) {
-        uint8_t rank = rank_yindex(sq);
-        uint8_t file = file_xindex(sq);
-        uint8_t nstep = 7 - rank;
-        uint8_t estep = 7 - file;
-        uint8_t sstep = rank;
-        uint8_t wstep = file;
-        edge_distance_64x8[sq][0] = nstep;
-        edge_distance_64x8[sq][1] = estep;
-        edge_distance_64x8[sq][2] = sstep;
-        edge_distance_64x8[sq][3] = wstep;
-        edge_distance_64x8[sq][4] = nstep < estep ? nstep : estep;
-        edge_distance_64x8[sq][5] = nstep < wstep ? nstep : wstep;
-        edge_distance_64x8[sq][6] = sstep < estep ? sstep : estep;
-        edge_distance_64x8[sq][7] = sstep < wstep ? sstep : wstep;
-    }
-}
-
-void Compass::compute_knight_attacks() {
-    for (int sq = 0; sq < 64; sq++) {
-        Compass::knight_attacks[sq] = 0ull;
-        if (edge_distance_64x8[sq][0] > 0) {
-            if (edge_distance_64x8[sq][0] > 1 && edge_distance_64x8[sq][1] > 0)
-                Compass::knight_attacks[sq] |= 1ull << (sq + directions::NNE);
-            if (edge_distance_64x8[sq][1] > 1)
-                Compass::knight_attacks[sq] |= 1ull << (sq + directions::NEE);
-            if (edge_distance_64x8[sq][0] > 1 && edge_distance_64x8[sq][3] > 0)
-                Compass::knight_attacks[sq] |= 1ull << (sq + directions::NNW);
-            if (edge_distance_64x8[sq][3] > 1)
-                Compass::knight_attacks[sq] |= 1ull << (sq + directions::NWW);
-        }
-        if (edge_distance_64x8[sq][2] > 0) {
-            if (edge_distance_64x8[sq][2] > 1 && edge_distance_64x8[sq][1] > 0)
-                Compass::knight_attacks[sq] |= 1ull << (sq + directions::SSE);
-            if (edge_distance_64x8[sq][1] > 1)
-                Compass::knight_attacks[sq] |= 1ull << (sq + directions::SEE);
-            if (edge_distance_64x8[sq][2] > 1 && edge_distance_64x8[sq][3] > 0)
-                Compass::knight_attacks[sq] |= 1ull << (sq + directions::SSW);
-            if (edge_distance_64x8[sq][3] > 1)
-                Compass::knight_attacks[sq] |= 1ull << (sq + directions::SWW);
-        }
-    }
-}
-
 const U64 Compass::rank_attacks(U64 occ, int sq) {
     int rook_file = file_xindex(sq);
     int rank_times8 = sq & 56; // rank * 8
     int rank_occ_times2 = (occ >> rank_times8) & 2 * 63;
     // return 8 * rank_occ + file shifted to the right rank
-    return first_rank_attacks_64x8[4*rank_occ_times2+rook_file] << rank_times8;
+    return (U64) first_rank_attacks_64x8[4*rank_occ_times2+rook_file] << rank_times8;
+}
+
+// Kogge-Stone rook attacks, used to fill the lookup tables
+const U64 Compass::rook_fill(U64 occ, int sq) {
+    U64 rook = 1ull << sq;
+    return BB::nort_attacks(rook, ~occ) | BB::sout_attacks(rook, ~occ)
+         | BB::east_attacks(rook, ~occ) | BB::west_attacks(rook, ~occ);
+}
+
+// Kogge-Stone bishop attacks, used to fill the lookup tables
+const U64 Compass::bishop_fill(U64 occ, int sq) {
+    U64 bishop = 1ull << sq;
+    return BB::NoEa_attacks(bishop, ~occ) | BB::NoWe_attacks(bishop, ~occ)
+         | BB::SoEa_attacks(bishop, ~occ) | BB::SoWe_attacks(bishop, ~occ);
 }
 
-void Compass::compute_rank_attacks() {
-    for (U64 occ = 0; occ < 64; occ++) for (int rksq = 0; rksq < 8; rksq++) {
-        U64 rook = 1ull << rksq;
-        first_rank_attacks_64x8[8*occ+rksq] = BB::east_attacks(rook, ~occ) & 255;
-        first_rank_attacks_64x8[8*occ+rksq] |= BB::west_attacks(rook, ~occ) & 255;
-        first_rank_attacks_64x8[8*occ+rksq] &= ~rook;
+/*
+ * Fill the rook and bishop attack tables
+ * Each square gets a slice of 2^(blocker squares) entries,
+ * one for every subset of its blocker mask.
+ */
+void Compass::compute_slider_attacks() {
+    const U64 EDGES_RANK = 0xff000000000000ffull;
+    const U64 EDGES_FILE = 0x8181818181818181ull;
+    U64* attacks = slider_attacks;
+    for (int bishop = 0; bishop < 2; bishop++) for (int sq = 0; sq < 64; sq++) {
+        Magic& m = bishop ? bishop_magics[sq] : rook_magics[sq];
+        // squares on the board edge never block anything
+        U64 edges = bishop ? EDGES_RANK | EDGES_FILE
+                  : (EDGES_RANK & ~(255ull << (sq & 56))) | (EDGES_FILE & ~(0x0101010101010101ull << (sq & 7)));
+        m.mask = (bishop ? bishop_fill(0ull, sq) : rook_fill(0ull, sq)) & ~edges;
+        m.magic = bishop ? BISHOP_MAGIC_NUMBERS[sq] : ROOK_MAGIC_NUMBERS[sq];
+        m.shift = 64 - BB::count_bits(m.mask);
+        m.attacks = attacks;
+        // walk every subset of the mask with the Carry-Rippler trick
+        U64 occ = 0ull;
+        do {
+            m.attacks[m.index(occ)] = bishop ? bishop_fill(occ, sq) : rook_fill(occ, sq);
+            occ = (occ - m.mask) & m.mask;
+        } while (occ);
+        attacks += 1ull << BB::count_bits(m.mask);
     }
 }
 
-void Compass::compute_king_attacks() {
-    for (int king_sq = 0; king_sq < 64; king_sq++) {
-        king_attacks[king_sq] = 0ull;
-        for (int dir_idx = get_dir_start_index(ch_cst::KING); dir_idx < get_dir_end_index(ch_cst::KING); dir_idx++) {
-            int dir = directions::DIRS[dir_idx];
-            if (edge_distance_64x8[king_sq][dir_idx] == 0)
-                continue;
-            king_attacks[king_sq] |= 1ull << (king_sq + dir);
+/*
+ * Fill the between and line tables from the empty board slider attacks,
+ * squares that share no rank, file or diagonal are left empty.
+ * Relies on the slider attack tables, so it must run after them.
+ */
+void Compass::compute_lines() {
+    for (int a = 0; a < 64; a++) for (int b = 0; b < 64; b++) {
+        between[a][b] = line[a][b] = 0ull;
+        if (a == b)
+            continue;
+        U64 ends = 1ull << a | 1ull << b;
+        if (rook_attacks(0ull, a) & 1ull << b) {
+            between[a][b] = rook_attacks(ends, a) & rook_attacks(ends, b);
+            line[a][b] = rook_attacks(0ull, a) & rook_attacks(0ull, b) | ends;
+        } else if (bishop_attacks(0ull, a) & 1ull << b) {
+            between[a][b] = bishop_attacks(ends, a) & bishop_attacks(ends, b);
+            line[a][b] = bishop_attacks(0ull, a) & bishop_attacks(0ull, b) | ends;
         }
     }
 }
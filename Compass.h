@@ -2,8 +2,12 @@
 #define COMPASS_H
 
 #include "Bitboard.h"
+#include <array>
 #include <iostream>
 #include <string>
+#ifdef USE_PEXT
+#include <immintrin.h>
+#endif
 
 #define U64 uint64_t
 
@@ -59,15 +63,167 @@ namespace directions {
     const int PAWN_DIR[2] = { NORTH, SOUTH };
 }
 
+/*
+ * Board geometry seen from one side, so that code templated
+ * on the side to move compiles without color branches.
+ */
+template<bool Black>
+struct Side {
+    static const int UP = Black ? directions::SOUTH : directions::NORTH;
+    static const int UP_EAST = Black ? directions::SOUTHEAST : directions::NORTHEAST;
+    static const int UP_WEST = Black ? directions::SOUTHWEST : directions::NORTHWEST;
+    // a single push onto this rank may go on to a double push
+    static const U64 THIRD_RANK = Black ? 255ull << 40 : 255ull << 16;
+    static const U64 LAST_RANK = Black ? 255ull : 255ull << 56;
+    // castle_rights bits and the rooks they castle with
+    static const int KING_CASTLE = Black ? 4 : 1;
+    static const int QUEEN_CASTLE = Black ? 8 : 2;
+    static const int KING_ROOK = Black ? ch_cst::h8 : ch_cst::h1;
+    static const int QUEEN_ROOK = Black ? ch_cst::a8 : ch_cst::a1;
+    static inline U64 up(U64 bb) { return Black ? bb >> 8 : bb << 8; }
+    static inline U64 up_east(U64 bb) { return Black ? (bb & BB::NOT_H_FILE) >> 7 : (bb & BB::NOT_H_FILE) << 9; }
+    static inline U64 up_west(U64 bb) { return Black ? (bb & BB::NOT_A_FILE) >> 9 : (bb & BB::NOT_A_FILE) << 7; }
+};
+
+/*
+ * Slider attack lookup for one square: the occupancy squares
+ * that can block it, the magic multiplier and shift that hash
+ * them to an index, and the square's slice of the attack table.
+ * Built with USE_PEXT, the index is the blocker bits packed by PEXT.
+ */
+struct Magic {
+    U64 mask;
+    U64 magic;
+    U64* attacks;
+    int shift;
+    inline unsigned index(U64 occ) const {
+#ifdef USE_PEXT
+        return (unsigned) _pext_u64(occ, mask);
+#else
+        return (unsigned) (((occ & mask) * magic) >> shift);
+#endif
+    }
+};
+
+/*
+ * Generators for the fixed geometry tables, evaluated by the compiler
+ * so the tables sit in read-only data and are ready before main() runs.
+ */
+namespace compass_tables {
+    typedef std::array<std::array<uint8_t, 8>, 64> EdgeDistances;
+
+    // steps to the board edge from every square in the first 8 DIRS
+    constexpr EdgeDistances edge_distances() {
+        EdgeDistances dist{};
+        for (int sq = 0; sq < 64; sq++) {
+            uint8_t nstep = 7 - (sq >> 3);
+            uint8_t estep = 7 - (sq & 7);
+            uint8_t sstep = sq >> 3;
+            uint8_t wstep = sq & 7;
+            dist[sq][0] = nstep;
+            dist[sq][1] = estep;
+            dist[sq][2] = sstep;
+            dist[sq][3] = wstep;
+            dist[sq][4] = nstep < estep ? nstep : estep;
+            dist[sq][5] = nstep < wstep ? nstep : wstep;
+            dist[sq][6] = sstep < estep ? sstep : estep;
+            dist[sq][7] = sstep < wstep ? sstep : wstep;
+        }
+        return dist;
+    }
+
+    constexpr std::array<U64, 64> knight_attacks() {
+        std::array<U64, 64> attacks{};
+        const EdgeDistances dist = edge_distances();
+        for (int sq = 0; sq < 64; sq++) {
+            if (dist[sq][0] > 0) {
+                if (dist[sq][0] > 1 && dist[sq][1] > 0)
+                    attacks[sq] |= 1ull << (sq + directions::NNE);
+                if (dist[sq][1] > 1)
+                    attacks[sq] |= 1ull << (sq + directions::NEE);
+                if (dist[sq][0] > 1 && dist[sq][3] > 0)
+                    attacks[sq] |= 1ull << (sq + directions::NNW);
+                if (dist[sq][3] > 1)
+                    attacks[sq] |= 1ull << (sq + directions::NWW);
+            }
+            if (dist[sq][2] > 0) {
+                if (dist[sq][2] > 1 && dist[sq][1] > 0)
+                    attacks[sq] |= 1ull << (sq + directions::SSE);
+                if (dist[sq][1] > 1)
+                    attacks[sq] |= 1ull << (sq + directions::SEE);
+                if (dist[sq][2] > 1 && dist[sq][3] > 0)
+                    attacks[sq] |= 1ull << (sq + directions::SSW);
+                if (dist[sq][3] > 1)
+                    attacks[sq] |= 1ull << (sq + directions::SWW);
+            }
+        }
+        return attacks;
+    }
+
+    constexpr std::array<U64, 64> king_attacks() {
+        std::array<U64, 64> attacks{};
+        const EdgeDistances dist = edge_distances();
+        const int dirs[8] = { directions::NORTH, directions::EAST, directions::SOUTH, directions::WEST,
+            directions::NORTHEAST, directions::NORTHWEST, directions::SOUTHEAST, directions::SOUTHWEST };
+        for (int sq = 0; sq < 64; sq++)
+            for (int dir_idx = 0; dir_idx < 8; dir_idx++)
+                attacks[sq] |= dist[sq][dir_idx] ? 1ull << (sq + dirs[dir_idx]) : 0ull;
+        return attacks;
+    }
+
+    /*
+     * Rook attacks along the first rank, indexed by [8 * occ + file]
+     * where occ holds the occupancy of files b-g, the only squares
+     * that can block anything
+     */
+    constexpr std::array<uint8_t, 64 * 8> first_rank_attacks() {
+        std::array<uint8_t, 64 * 8> attacks{};
+        for (int occ = 0; occ < 64; occ++) for (int file = 0; file < 8; file++) {
+            int rank_occ = occ << 1;
+            uint8_t ray = 0;
+            for (int east = file + 1; east < 8; east++) {
+                ray |= 1 << east;
+                if (rank_occ & 1 << east)
+                    break;
+            }
+            for (int west = file - 1; west >= 0; west--) {
+                ray |= 1 << west;
+                if (rank_occ & 1 << west)
+                    break;
+            }
+            attacks[8 * occ + file] = ray;
+        }
+        return attacks;
+    }
+}
+
 class Compass
 {
 public:
     Compass();
-    static U64 knight_attacks[64];
-    static U64 king_attacks[64];
-    static uint8_t edge_distance_64x8[64][8];
-    static uint8_t first_rank_attacks_64x8[64*8]; // 64 * 8 = 512 Bytes = 1/2 KByte
+    static constexpr std::array<U64, 64> knight_attacks = compass_tables::knight_attacks();
+    static constexpr std::array<U64, 64> king_attacks = compass_tables::king_attacks();
+    static constexpr compass_tables::EdgeDistances edge_distance_64x8 = compass_tables::edge_distances();
+    // 64 * 8 = 512 Bytes = 1/2 KByte
+    static constexpr std::array<uint8_t, 64 * 8> first_rank_attacks_64x8 = compass_tables::first_rank_attacks();
+    static Magic rook_magics[64];
+    static Magic bishop_magics[64];
+    // squares strictly between two squares on a shared rank, file or diagonal
+    static U64 between[64][64];
+    // the whole rank, file or diagonal through two squares, edge to edge
+    static U64 line[64][64];
     const static U64 rank_attacks(U64 occ, int sq);
+    inline const static U64 rook_attacks(U64 occ, int sq) {
+        return rook_magics[sq].attacks[rook_magics[sq].index(occ)];
+    }
+    inline const static U64 bishop_attacks(U64 occ, int sq) {
+        return bishop_magics[sq].attacks[bishop_magics[sq].index(occ)];
+    }
+    inline const static U64 queen_attacks(U64 occ, int sq) {
+        return rook_attacks(occ, sq) | bishop_attacks(occ, sq);
+    }
+    const static U64 rook_fill(U64 occ, int sq);
+    const static U64 bishop_fill(U64 occ, int sq);
     const static U64 build_ray(int sq, int dir_index);
     const static U64 build_ray(int sq[2]);
     const static U64 ray_square(int start, int end, U64 occ = 0ull);
@@ -77,10 +233,10 @@ public:
     const static int rank_yindex(int sq);
     const static int file_xindex(int sq);
 private:
-    static void compute_edge_distances();
-    static void compute_knight_attacks();
-    static void compute_rank_attacks();
-    static void compute_king_attacks();
+    static void compute_slider_attacks();
+    static void compute_lines();
+    // every rook and bishop square's attack set, 107648 * 8 Bytes = 841 KBytes
+    static U64 slider_attacks[102400 + 5248];
 };
 
 #endif
@@ -18,18 +18,18 @@ int Move::promote(const move& m) {
 
 std::string Move::to_string(const move m) {
     return ch_cst::string_from_square[start(m)]+ ch_cst::string_from_square[end(m)]
-        + (promote(m) ? "=" + ch_cst::piece_char[promote(m)] : "");
+        + (promote(m) ? std::string("=") + ch_cst::piece_char[promote(m)] : "");
 }
 
 /*
- * Method to shift each element before pos in an array to the right.
- * The first element of the array is replaced with the element at pos.
+ * Method to shift each move before pos in a list to the right.
+ * The first move of the list is replaced with the move at pos.
  */
-void Move::arr_shift_right(move (&arr)[MAXMOVES], int pos) {
-    move best = arr[pos];
+void Move::arr_shift_right(MoveList& list, int pos) {
+    move best = list.moves[pos];
     while (pos > 0) {
-        arr[pos] = arr[pos - 1];
+        list.moves[pos] = list.moves[pos - 1];
         pos--;
     }
-    arr[0] = best;
+    list.moves[0] = best;
 }
@@ -5,7 +5,28 @@
 #include <iostream>
 
 typedef uint16_t move;
-#define MAXMOVES 120
+// no position has more than 218 legal moves
+#define MAXMOVES 256
+
+/*
+ * A list of moves that the move generator appends to,
+ * with a score for each move to order them by.
+ * Scores are only meaningful once the user has written them.
+ */
+struct MoveList {
+    move moves[MAXMOVES];
+    int scores[MAXMOVES];
+    int count = 0;
+    inline void add(move mv) { moves[count++] = mv; }
+    inline void clear() { count = 0; }
+    inline int size() const { return count; }
+    inline move& operator[](int i) { return moves[i]; }
+    inline move operator[](int i) const { return moves[i]; }
+    inline move* begin() { return moves; }
+    inline move* end() { return moves + count; }
+    inline const move* begin() const { return moves; }
+    inline const move* end() const { return moves + count; }
+};
 
 namespace Move
 {
@@ -13,7 +34,7 @@ namespace Move
     int start(const move& m);
     int end(const move& m);
     int promote(const move& m);
-    void arr_shift_right(move (&arr)[MAXMOVES], int pos);
+    void arr_shift_right(MoveList& list, int pos);
     std::string to_string(const move m);
 };
 
@@ -2,9 +2,48 @@
 
 void MoveGenerator::init(bool test) {
     ch = *Chess::state();
-    op_attack_mask = gen_op_attack_mask(test);
-    checks_exist(test);
-    pinned_pieces = find_pins(test);
+    const AttackInfo& info = attack_info(ch, false, test);
+    op_attack_mask = info.attacks[!ch.black_to_move];
+    in_check = info.in_check;
+    in_double_check = info.in_double_check;
+    check_ray = info.check_ray;
+    pinned_pieces = info.pinned;
+}
+
+/*
+ * Method to get the attack maps of a position,
+ * computed the first time they are asked for and then cached
+ * @param pos the position, its cache is filled in if needed
+ * @param both_sides false if only the opponents' attacks are needed
+ * @return the position's filled in attack info
+ */
+const AttackInfo& MoveGenerator::attack_info(Chess& pos, bool both_sides, bool test) {
+    MoveGenerator gen(pos);
+    if (!pos.attack_info.valid)
+        pos.black_to_move ? gen.fill_attack_info<true>(test) : gen.fill_attack_info<false>(test);
+    if (both_sides && !pos.attack_info.both_sides) {
+        // attacks of the side to move, as its opponent would see them
+        pos.attack_info.attacks[pos.black_to_move] = pos.black_to_move ? gen.op_attacks<false>() : gen.op_attacks<true>();
+        pos.attack_info.both_sides = true;
+    }
+    return pos.attack_info;
+}
+
+/*
+ * Fill the opponents' attacks, checks and pins of ch
+ */
+template<bool Black>
+void MoveGenerator::fill_attack_info(bool test) {
+    AttackInfo& info = ch.attack_info;
+    op_attack_mask = op_attacks<Black>();
+    info.checkers = checks_exist<Black>(test);
+    pinned_pieces = find_pins<Black>(test);
+    info.attacks[!Black] = op_attack_mask;
+    info.check_ray = check_ray;
+    info.pinned = pinned_pieces;
+    info.in_check = in_check;
+    info.in_double_check = in_double_check;
+    info.valid = true;
 }
 
 /*
@@ -14,129 +53,73 @@ void MoveGenerator::init(bool test) {
  * @return false if any legal moves exist
  */
 bool MoveGenerator::is_game_over(bool test) {
-    move moves[MAXMOVES] = {};
+    MoveList moves;
     gen_moves(moves);
-    return !moves[MAXMOVES - 1] || ch.halfmoves > 49 || ch.repetitions() > 2;
+    return !moves.size() || ch.halfmoves > 49 || ch.repetitions() > 2;
 }
 
-void MoveGenerator::checks_exist(bool test) {
-    using namespace directions;
-    U64 king = ch.bb_kings & *ch.bb_color[ch.black_to_move];
+/*
+ * Finds the pieces giving check and the squares that answer a single check
+ * @return the bitboard of checking pieces
+ */
+template<bool Black>
+U64 MoveGenerator::checks_exist(bool test) {
+    U64 own = Black ? ch.bb_black : ch.bb_white;
+    U64 op = Black ? ch.bb_white : ch.bb_black;
+    U64 king = ch.bb_kings & own;
     in_check = false;
     in_double_check = false;
     check_ray = 0ull;
 
     if (!(king & op_attack_mask))
-        return;
-
-    U64 op = *ch.bb_color[1 - ch.black_to_move];
-    int ksq = ch.find_king(ch.black_to_move);
-
-    // knights
-    U64 attackers = ch.bb_knights & op & Compass::knight_attacks[ksq];
-    if (attackers) {
-        check_ray = attackers & 0-attackers;
-        check_method();
-    }
-
-    // pawns
-    attackers = BB::gen_shift(king & BB::NOT_H_FILE, DIRS[4 + 2 * (ch.black_to_move)]) | BB::gen_shift(king & BB::NOT_A_FILE, DIRS[5 + 2 * (ch.black_to_move)]);
-    if (attackers & op & ch.bb_pawns) {
-        check_ray = attackers & ch.bb_pawns & op;
-        check_method();
-    }
-
-    // bishops
-    attackers = BB::NoEa_attacks(king, ~ch.bb_occ);
-    if (attackers & (ch.bb_queens | ch.bb_bishops) & op) {
-        check_ray = attackers;
-        check_method();
-    }
-    attackers = BB::NoWe_attacks(king, ~ch.bb_occ);
-    if (attackers & (ch.bb_queens | ch.bb_bishops) & op) {
-        check_ray = attackers;
-        check_method();
-    }
-    attackers = BB::SoEa_attacks(king, ~ch.bb_occ);
-    if (attackers & (ch.bb_queens | ch.bb_bishops) & op) {
-        check_ray = attackers;
-        check_method();
-    }
-    attackers = BB::SoWe_attacks(king, ~ch.bb_occ);
-    if (attackers & (ch.bb_queens | ch.bb_bishops) & op) {
-        check_ray = attackers;
-        check_method();
-    }
-
-    // rooks
-    attackers = BB::nort_attacks(king, ~ch.bb_occ);
-    if (attackers & (ch.bb_queens | ch.bb_rooks) & op) {
-        check_ray = attackers;
-        check_method();
-    }
-    attackers = BB::sout_attacks(king, ~ch.bb_occ);
-    if (attackers & (ch.bb_queens | ch.bb_rooks) & op) {
-        check_ray = attackers;
-        check_method();
-    }
-    attackers = BB::east_attacks(king, ~ch.bb_occ);
-    if (attackers & (ch.bb_queens | ch.bb_rooks) & op) {
-        check_ray = attackers;
-        check_method();
-    }
-    attackers = BB::west_attacks(king, ~ch.bb_occ);
-    if (attackers & (ch.bb_queens | ch.bb_rooks) & op) {
-        check_ray = attackers;
-        check_method();
-    }
-}
-
-void MoveGenerator::check_method() {
-    if (in_check) in_double_check = true;
-    else in_check = true;
+        return 0ull;
+
+    int ksq = ch.find_king(Black);
+    U64 checkers = op & (
+          ch.bb_knights & Compass::knight_attacks[ksq]
+        | ch.bb_pawns & (Side<Black>::up_east(king) | Side<Black>::up_west(king))
+        | (ch.bb_bishops | ch.bb_queens) & Compass::bishop_attacks(ch.bb_occ, ksq)
+        | (ch.bb_rooks | ch.bb_queens) & Compass::rook_attacks(ch.bb_occ, ksq));
+    in_check = true;
+    in_double_check = checkers & (checkers - 1);
+    // the check ray runs between the king and the checker
+    if (!in_double_check)
+        check_ray = Compass::between[ksq][BB::lsb(checkers)] | checkers;
+    return checkers;
 }
 
 // setup method to get pins in a position
 // modifies a bitboard of squares containing pinning pieces
+template<bool Black>
 U64 MoveGenerator::find_pins(bool test) {
-    // active king
-    U64 king = ch.bb_kings & *ch.bb_color[ch.black_to_move];
+    U64 own = Black ? ch.bb_black : ch.bb_white;
+    U64 op = Black ? ch.bb_white : ch.bb_black;
     // enemy sliding pieces
-    U64 en_rooks = (ch.bb_rooks | ch.bb_queens) & *ch.bb_color[!ch.black_to_move];
-    U64 en_bishops = (ch.bb_bishops | ch.bb_queens) & *ch.bb_color[!ch.black_to_move];
-
-    // North
-    U64 ray = BB::nort_attacks(king, ~*ch.bb_color[!ch.black_to_move]);
-    U64 pinned = (ray & en_rooks && BB::count_bits(ray & *ch.bb_color[ch.black_to_move]) == 1)
-            ? ray & *ch.bb_color[ch.black_to_move] : 0ull;
-    // East
-    ray = BB::east_attacks(king, ~*ch.bb_color[!ch.black_to_move]);
-    pinned |= (ray & en_rooks && BB::count_bits(ray & *ch.bb_color[ch.black_to_move]) == 1)
-            ? ray & *ch.bb_color[ch.black_to_move] : 0ull;
-    // South
-    ray = BB::sout_attacks(king, ~*ch.bb_color[!ch.black_to_move]);
-    pinned |= (ray & en_rooks && BB::count_bits(ray & *ch.bb_color[ch.black_to_move]) == 1)
-            ? ray & *ch.bb_color[ch.black_to_move] : 0ull;
-    // West
-    ray = BB::west_attacks(king, ~*ch.bb_color[!ch.black_to_move]);
-    pinned |= (ray & en_rooks && BB::count_bits(ray & *ch.bb_color[ch.black_to_move]) == 1)
-            ? ray & *ch.bb_color[ch.black_to_move] : 0ull;
-    // NorthEast
-    ray = BB::NoEa_attacks(king, ~*ch.bb_color[!ch.black_to_move]);
-    pinned |= (ray & en_bishops && BB::count_bits(ray & *ch.bb_color[ch.black_to_move]) == 1)
-            ? ray & *ch.bb_color[ch.black_to_move] : 0ull;
-    // NorthWest
-    ray = BB::NoWe_attacks(king, ~*ch.bb_color[!ch.black_to_move]);
-    pinned |= (ray & en_bishops && BB::count_bits(ray & *ch.bb_color[ch.black_to_move]) == 1)
-            ? ray & *ch.bb_color[ch.black_to_move] : 0ull;
-    // SouthEast
-    ray = BB::SoEa_attacks(king, ~*ch.bb_color[!ch.black_to_move]);
-    pinned |= (ray & en_bishops && BB::count_bits(ray & *ch.bb_color[ch.black_to_move]) == 1)
-            ? ray & *ch.bb_color[ch.black_to_move] : 0ull;
-    // SouthWest
-    ray = BB::SoWe_attacks(king, ~*ch.bb_color[!ch.black_to_move]);
-    pinned |= (ray & en_bishops && BB::count_bits(ray & *ch.bb_color[ch.black_to_move]) == 1)
-            ? ray & *ch.bb_color[ch.black_to_move] : 0ull;
+    U64 en_rooks = (ch.bb_rooks | ch.bb_queens) & op;
+    U64 en_bishops = (ch.bb_bishops | ch.bb_queens) & op;
+    int ksq = ch.find_king(Black);
+
+    // look through our own pieces to the first enemy piece on each line
+    // a slider there pins our piece if it is the only one in between
+    U64 pinners = Compass::rook_attacks(op, ksq) & en_rooks;
+    U64 pinned = 0ull;
+    while (pinners) {
+        // square of the LS1B
+        int sq = BB::lsb(pinners);
+        U64 between = Compass::between[ksq][sq] & own;
+        pinned |= BB::count_bits(between) == 1 ? between : 0ull;
+        // now clear that LS1B
+        pinners &= pinners - 1;
+    }
+    pinners = Compass::bishop_attacks(op, ksq) & en_bishops;
+    while (pinners) {
+        // square of the LS1B
+        int sq = BB::lsb(pinners);
+        U64 between = Compass::between[ksq][sq] & own;
+        pinned |= BB::count_bits(between) == 1 ? between : 0ull;
+        // now clear that LS1B
+        pinners &= pinners - 1;
+    }
 
     // if (test && pinned)
     // {
@@ -152,35 +135,46 @@ U64 MoveGenerator::find_pins(bool test) {
  * @return the bitboard of squares attacked by opponent's pieces
  */
 U64 MoveGenerator::gen_op_attack_mask(bool test) {
-    U64 mask = Compass::king_attacks[ch.find_king(!ch.black_to_move)];
-    U64 op = *ch.bb_color[!ch.black_to_move];
-    U64 empty = ~ch.bb_occ | (ch.bb_kings & *ch.bb_color[ch.black_to_move]);
+    return ch.black_to_move ? op_attacks<true>() : op_attacks<false>();
+}
+
+/*
+ * The opponents' attack mask when Black is the side to move
+ */
+template<bool Black>
+U64 MoveGenerator::op_attacks() const {
+    U64 op = Black ? ch.bb_white : ch.bb_black;
+    U64 mask = Compass::king_attacks[ch.find_king(!Black)];
+    // our king doesn't block attacks, so it can't step back along a check
+    U64 occ = ch.bb_occ & ~(ch.bb_kings & (Black ? ch.bb_black : ch.bb_white));
 
     // pawn attacks
-    U64 pattacksWest = ch.black_to_move ? BB::NoWe_shift_one(ch.bb_pawns & op) : BB::SoWe_shift_one(ch.bb_pawns & op);
-    U64 pattacksEast = ch.black_to_move ? BB::NoEa_shift_one(ch.bb_pawns & op) : BB::SoEa_shift_one(ch.bb_pawns & op);
-    mask |= pattacksEast;
-    mask |= pattacksWest;
+    mask |= Side<!Black>::up_east(ch.bb_pawns & op);
+    mask |= Side<!Black>::up_west(ch.bb_pawns & op);
 
     // rooks & queens
     U64 attackers = (ch.bb_rooks | ch.bb_queens) & op;
-    mask |= BB::nort_attacks(attackers, empty);
-    mask |= BB::sout_attacks(attackers, empty);
-    mask |= BB::east_attacks(attackers, empty);
-    mask |= BB::west_attacks(attackers, empty);
+    while (attackers) {
+        // square of the LS1B
+        mask |= Compass::rook_attacks(occ, BB::lsb(attackers));
+        // now clear that LS1B
+        attackers &= attackers - 1;
+    }
 
     // bishops & queens
     attackers = (ch.bb_bishops | ch.bb_queens) & op;
-    mask |= BB::NoEa_attacks(attackers, empty);
-    mask |= BB::NoWe_attacks(attackers, empty);
-    mask |= BB::SoEa_attacks(attackers, empty);
-    mask |= BB::SoWe_attacks(attackers, empty);
+    while (attackers) {
+        // square of the LS1B
+        mask |= Compass::bishop_attacks(occ, BB::lsb(attackers));
+        // now clear that LS1B
+        attackers &= attackers - 1;
+    }
 
     // knights
     attackers = ch.bb_knights & op;
     while (attackers) {
-        // x & -x masks the LS1B
-        mask |= Compass::knight_attacks[63 - BB::lz_count(attackers & 0-attackers)];
+        // square of the LS1B
+        mask |= Compass::knight_attacks[BB::lsb(attackers)];
         // now clear that LS1B
         attackers &= attackers - 1;
     }
@@ -189,326 +183,554 @@ U64 MoveGenerator::gen_op_attack_mask(bool test) {
 
 /*
  * Method to get the legal moves in a position.
- * @return an array of all legal moves
+ * @return the list of all legal moves
  */
-move* MoveGenerator::gen_moves(move (&moves)[MAXMOVES], bool test) {
+MoveList& MoveGenerator::gen_moves(MoveList& moves, bool test) {
     init(test);
 
-    moves[MAXMOVES - 1] = 0;
+    moves.clear();
     if (ch.repetitions() > 2)
         return moves;
-    move temp[MAXMOVES] = {};
+    return gen_stage(moves, GEN_ALL, test);
+}
+
+/*
+ * Method to get one kind of legal moves, for staged move ordering.
+ * Relies on init() having been called for the position.
+ * @param kinds GEN_CAPTURES, GEN_QUIETS or both
+ * @return the list of legal moves of those kinds
+ */
+MoveList& MoveGenerator::gen_stage(MoveList& moves, int kinds, bool test) {
+    moves.clear();
+    if (ch.black_to_move)
+        gen_side<true>(moves, kinds, test);
+    else
+        gen_side<false>(moves, kinds, test);
+    return moves;
+}
+
+template<bool Black>
+void MoveGenerator::gen_side(MoveList& moves, int kinds, bool test) {
+    U64 own = Black ? ch.bb_black : ch.bb_white;
+    U64 op = Black ? ch.bb_white : ch.bb_black;
+    U64 targets = (kinds & GEN_CAPTURES ? op : 0ull)
+                | (kinds & GEN_QUIETS ? ~ch.bb_occ : 0ull);
+    int king_sq = ch.find_king(Black);
 
     // king
-    gen_king_piece_moves(temp, test);
-    for (int i = 0; i < temp[MAXMOVES - 1]; i++) {
-        moves[moves[MAXMOVES - 1]] = temp[i];
-        moves[MAXMOVES - 1] += moves[MAXMOVES - 1] < MAXMOVES - 2 ? 1 : 0;
-    }
-    temp[MAXMOVES - 1] = 0;
-    if (in_double_check) return moves;
+    gen_king_piece_moves<Black>(moves, kinds, test);
+    if (in_double_check) return;
+
+    // in check, every other piece must capture the checker or block
+    targets &= in_check ? check_ray : ~0ull;
 
     // rooks and queens
-    U64 ss = (ch.bb_rooks | ch.bb_queens) & *ch.bb_color[ch.black_to_move];
+    U64 ss = (ch.bb_rooks | ch.bb_queens) & own;
     while (ss) {
-        // x & -x masks the LS1B
-        gen_rook_piece_moves(temp, 63 - BB::lz_count(ss & 0-ss), test);
-        for (int i = 0; i < temp[MAXMOVES - 1]; i++) {
-            moves[moves[MAXMOVES - 1]] = temp[i];
-            moves[MAXMOVES - 1] += moves[MAXMOVES - 1] < MAXMOVES - 2 ? 1 : 0;
-        }
-        temp[MAXMOVES - 1] = 0;
+        // square of the LS1B
+        gen_rook_piece_moves(moves, BB::lsb(ss), king_sq, targets, test);
         // now clear that LS1B
         ss &= ss - 1;
     }
 
     // bishops and queens
-    ss = (ch.bb_bishops | ch.bb_queens) & *ch.bb_color[ch.black_to_move];
+    ss = (ch.bb_bishops | ch.bb_queens) & own;
     while (ss) {
-        // x & -x masks the LS1B
-        gen_bishop_piece_moves(temp, 63 - BB::lz_count(ss & 0-ss), test);
-        for (int i = 0; i < temp[MAXMOVES - 1]; i++) {
-            moves[moves[MAXMOVES - 1]] = temp[i];
-            moves[MAXMOVES - 1] += moves[MAXMOVES - 1] < MAXMOVES - 2 ? 1 : 0;
-        }
-        temp[MAXMOVES - 1] = 0;
+        // square of the LS1B
+        gen_bishop_piece_moves(moves, BB::lsb(ss), king_sq, targets, test);
         // now clear that LS1B
         ss &= ss - 1;
     }
 
     // knights
-    ss = ch.bb_knights & *ch.bb_color[ch.black_to_move];
+    ss = ch.bb_knights & own;
     while (ss) {
-        // x & -x masks the LS1B
-        gen_knight_piece_moves(temp, 63 - BB::lz_count(ss & 0-ss), test);
-        for (int i = 0; i < temp[MAXMOVES - 1]; i++) {
-            moves[moves[MAXMOVES - 1]] = temp[i];
-            moves[MAXMOVES - 1] += moves[MAXMOVES - 1] < MAXMOVES - 2 ? 1 : 0;
-        }
-        temp[MAXMOVES - 1] = 0;
+        // square of the LS1B
+        gen_knight_piece_moves(moves, BB::lsb(ss), targets, test);
         // now clear that LS1B
         ss &= ss - 1;
     }
 
     // pawns
-    gen_pawn_moves(temp, test);
-    for (int i = 0; i < temp[MAXMOVES - 1]; i++) {
-        moves[moves[MAXMOVES - 1]] = temp[i];
-        moves[MAXMOVES - 1] += moves[MAXMOVES - 1] < MAXMOVES - 2 ? 1 : 0;
+    gen_pawn_moves<Black>(moves, kinds, test);
+}
+
+/*
+ * Method to count the legal moves in a position without writing them.
+ * Follows the same rules as gen_moves(), used to bulk-count perft leaves.
+ * @return the number of legal moves
+ */
+int MoveGenerator::count_moves(bool test) {
+    init(test);
+    if (ch.repetitions() > 2)
+        return 0;
+    return ch.black_to_move ? count_side<true>(test) : count_side<false>(test);
+}
+
+template<bool Black>
+int MoveGenerator::count_side(bool test) {
+    // king
+    int count = count_king_moves<Black>(test);
+    if (in_double_check) return count;
+
+    U64 own = Black ? ch.bb_black : ch.bb_white;
+    U64 targets = ~own & (in_check ? check_ray : ~0ull);
+    int king_sq = ch.find_king(Black);
+
+    // rooks and queens
+    U64 ss = (ch.bb_rooks | ch.bb_queens) & own;
+    while (ss) {
+        // square of the LS1B
+        int start = BB::lsb(ss);
+        U64 ts = Compass::rook_attacks(ch.bb_occ, start) & targets;
+        if (BB::contains_square(pinned_pieces, start))
+            ts &= Compass::line[king_sq][start];
+        count += BB::count_bits(ts);
+        // now clear that LS1B
+        ss &= ss - 1;
     }
-    return moves;
+
+    // bishops and queens
+    ss = (ch.bb_bishops | ch.bb_queens) & own;
+    while (ss) {
+        // square of the LS1B
+        int start = BB::lsb(ss);
+        U64 ts = Compass::bishop_attacks(ch.bb_occ, start) & targets;
+        if (BB::contains_square(pinned_pieces, start))
+            ts &= Compass::line[king_sq][start];
+        count += BB::count_bits(ts);
+        // now clear that LS1B
+        ss &= ss - 1;
+    }
+
+    // knights, pinned knights can never move
+    ss = ch.bb_knights & own & ~pinned_pieces;
+    while (ss) {
+        // square of the LS1B
+        count += BB::count_bits(Compass::knight_attacks[BB::lsb(ss)] & targets);
+        // now clear that LS1B
+        ss &= ss - 1;
+    }
+
+    // pawns
+    return count + count_pawn_moves<Black>(targets, test);
 }
 
 /*
  * Generates legal pawn moves
- * @return an unsorted list of pawn moves
+ * Appends an unsorted list of pawn moves
  */
-void MoveGenerator::gen_pawn_moves(move (&pawn_moves)[MAXMOVES], bool test) {
-    using namespace directions;
-    U64 pawns = ch.bb_pawns & *ch.bb_color[ch.black_to_move];
-    pawn_moves[MAXMOVES] = {};
+template<bool Black>
+void MoveGenerator::gen_pawn_moves(MoveList& moves, int kinds, bool test) {
+    typedef Side<Black> S;
+    U64 pawns = ch.bb_pawns & (Black ? ch.bb_black : ch.bb_white);
     if (!pawns) return;
-    U64 op = *ch.bb_color[!ch.black_to_move];
+    U64 op = Black ? ch.bb_white : ch.bb_black;
+    U64 ep = ch.ep_square > -1 ? 1ull << ch.ep_square : 0ull;
+    int king_sq = ch.find_king(Black);
+    // in check, pawns must capture the checker or block
+    // an en passant capture may remove the checking pawn
+    U64 evasions = in_check ? check_ray : ~0ull;
+    if (in_check && ep && check_ray & 1ull << (ch.ep_square - S::UP))
+        evasions |= ep;
+    // en passant captures land on an empty square
+    U64 capture_targets = kinds & GEN_CAPTURES ? (op | ep) & evasions : 0ull;
 
     // pawn captures
-    U64 captures_east = (ch.black_to_move) ? BB::SoEa_shift_one(pawns) & (op | (uint64_t) (ch.ep_square > -1) << ch.ep_square)
-                        /* white's move */ : BB::NoEa_shift_one(pawns) & (op | (uint64_t) (ch.ep_square > -1) << ch.ep_square);
-    U64 captures_west = (ch.black_to_move) ? BB::SoWe_shift_one(pawns) & (op | (uint64_t) (ch.ep_square > -1) << ch.ep_square)
-                        /* white's move */ : BB::NoWe_shift_one(pawns) & (op | (uint64_t) (ch.ep_square > -1) << ch.ep_square);
-
-    // eastern captures
-    while (captures_east) {
-        // x & -x masks the LS1B
-        int end_sq = 63 - BB::lz_count(captures_east & 0-captures_east);
+    U64 captures[2] = { S::up_east(pawns) & capture_targets, S::up_west(pawns) & capture_targets };
+    const int capture_dirs[2] = { S::UP_EAST, S::UP_WEST };
+    for (int side = 0; side < 2; side++) while (captures[side]) {
+        // square of the LS1B
+        int end_sq = BB::lsb(captures[side]);
         // now clear that LS1B
-        captures_east &= captures_east - 1;
-        int start_sq = end_sq - DIRS[4 + 2 * ch.black_to_move];
+        captures[side] &= captures[side] - 1;
+        int start_sq = end_sq - capture_dirs[side];
         if (BB::contains_square(pinned_pieces, start_sq)
-                && !BB::contains_square(Compass::ray_square(ch.find_king(ch.black_to_move), start_sq, op), end_sq))
+                && !BB::contains_square(Compass::line[king_sq][start_sq], end_sq))
+            continue;
+        if (end_sq == ch.ep_square && ep_exposes_king<Black>(start_sq))
             continue;
-        if (Compass::rank_yindex(end_sq) % 7 != 0) {
-            pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq);
-            pawn_moves[MAXMOVES - 1]++;
+        if (!(S::LAST_RANK & 1ull << end_sq)) {
+            moves.add(Move::build_move(start_sq, end_sq));
         } else {
             // pawn promotions
-            pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::QUEEN);
-            pawn_moves[MAXMOVES - 1]++;
-            pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::ROOK);
-            pawn_moves[MAXMOVES - 1]++;
-            pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::KNIGHT);
-            pawn_moves[MAXMOVES - 1]++;
-            pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::BISHOP);
-            pawn_moves[MAXMOVES - 1]++;
+            moves.add(Move::build_move(start_sq, end_sq, ch_cst::QUEEN));
+            moves.add(Move::build_move(start_sq, end_sq, ch_cst::ROOK));
+            moves.add(Move::build_move(start_sq, end_sq, ch_cst::KNIGHT));
+            moves.add(Move::build_move(start_sq, end_sq, ch_cst::BISHOP));
         }
     }
 
-    // western captures
-    while (captures_west) {
-        // x & -x masks the LS1B
-        int end_sq = 63 - BB::lz_count(captures_west & 0-captures_west);
+    // pawn pushes
+    U64 single = S::up(pawns) & ~ch.bb_occ;
+    U64 twice = S::up(single & S::THIRD_RANK) & ~ch.bb_occ;
+    // promotions are generated with the captures
+    U64 push_targets = ((kinds & GEN_CAPTURES ? S::LAST_RANK : 0ull)
+                     | (kinds & GEN_QUIETS ? ~S::LAST_RANK : 0ull)) & evasions;
+    single &= push_targets;
+    twice &= push_targets;
+    while (single) {
+        // square of the LS1B
+        int end_sq = BB::lsb(single);
         // now clear that LS1B
-        captures_west &= captures_west - 1;
-        int start_sq = end_sq - DIRS[5 + 2 * ch.black_to_move];
+        single &= single - 1;
+        int start_sq = end_sq - S::UP;
         if (BB::contains_square(pinned_pieces, start_sq)
-                && !BB::contains_square(Compass::ray_square(ch.find_king(ch.black_to_move), start_sq, op), end_sq))
+                && !BB::contains_square(Compass::line[king_sq][start_sq], end_sq))
             continue;
-        if (Compass::rank_yindex(end_sq) % 7 != 0) {
-            pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq);
-            pawn_moves[MAXMOVES - 1]++;
+        if (!(S::LAST_RANK & 1ull << end_sq)) {
+            moves.add(Move::build_move(start_sq, end_sq));
         } else {
             // pawn promotions
-            pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::QUEEN);
-            pawn_moves[MAXMOVES - 1]++;
-            pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::ROOK);
-            pawn_moves[MAXMOVES - 1]++;
-            pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::KNIGHT);
-            pawn_moves[MAXMOVES - 1]++;
-            pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::BISHOP);
-            pawn_moves[MAXMOVES - 1]++;
+            moves.add(Move::build_move(start_sq, end_sq, ch_cst::QUEEN));
+            moves.add(Move::build_move(start_sq, end_sq, ch_cst::ROOK));
+            moves.add(Move::build_move(start_sq, end_sq, ch_cst::KNIGHT));
+            moves.add(Move::build_move(start_sq, end_sq, ch_cst::BISHOP));
         }
     }
+    // double advances
+    while (twice) {
+        // square of the LS1B
+        int end_sq = BB::lsb(twice);
+        // now clear that LS1B
+        twice &= twice - 1;
+        int start_sq = end_sq - 2 * S::UP;
+        if (BB::contains_square(pinned_pieces, start_sq)
+                && !BB::contains_square(Compass::line[king_sq][start_sq], end_sq))
+            continue;
+        moves.add(Move::build_move(start_sq, end_sq));
+    }
+}
+
+/*
+ * Counts legal pawn moves, each promotion counts as four moves
+ * @param targets squares a move may end on, if in check
+ */
+template<bool Black>
+int MoveGenerator::count_pawn_moves(U64 targets, bool test) {
+    typedef Side<Black> S;
+    U64 pawns = ch.bb_pawns & (Black ? ch.bb_black : ch.bb_white);
+    if (!pawns) return 0;
+    U64 op = Black ? ch.bb_white : ch.bb_black;
+    U64 ep = ch.ep_square > -1 ? 1ull << ch.ep_square : 0ull;
+    int king_sq = ch.find_king(Black);
+    int count = 0;
+
+    // an en passant capture may remove the checking pawn
+    if (in_check && ep && check_ray & 1ull << (ch.ep_square - S::UP))
+        targets |= ep;
+
+    // pawn captures
+    U64 captures[2] = { S::up_east(pawns) & (op | ep) & targets, S::up_west(pawns) & (op | ep) & targets };
+    const int capture_dirs[2] = { S::UP_EAST, S::UP_WEST };
+    for (int side = 0; side < 2; side++) while (captures[side]) {
+        // square of the LS1B
+        int end_sq = BB::lsb(captures[side]);
+        // now clear that LS1B
+        captures[side] &= captures[side] - 1;
+        int start_sq = end_sq - capture_dirs[side];
+        if (BB::contains_square(pinned_pieces, start_sq)
+                && !BB::contains_square(Compass::line[king_sq][start_sq], end_sq))
+            continue;
+        if (end_sq == ch.ep_square && ep_exposes_king<Black>(start_sq))
+            continue;
+        count += S::LAST_RANK & 1ull << end_sq ? 4 : 1;
+    }
 
     // pawn pushes
-    U64 pawn_advances = ch.black_to_move
-            ? (pawns >> 8) & ~ch.bb_occ
-            : (pawns << 8) & ~ch.bb_occ;
-    pawn_advances |= ch.black_to_move
-            ? ((pawn_advances & 255ull << 40) >> 8) & ~ch.bb_occ
-            : ((pawn_advances & 255ull << 16) << 8) & ~ch.bb_occ;
-    while (pawn_advances) {
-        // x & -x masks the LS1B
-        int end_sq = 63 - BB::lz_count(pawn_advances & 0-pawn_advances);
-         // now clear that LS1B
-        pawn_advances &= pawn_advances - 1;
-        int start_sq = end_sq - PAWN_DIR[ch.black_to_move];
-        if (BB::contains_square(pawns, start_sq)
-                && (!BB::contains_square(pinned_pieces, start_sq)
-                    || Compass::file_xindex(ch.find_king(ch.black_to_move)) == Compass::file_xindex(end_sq))) {
-            if (Compass::rank_yindex(end_sq) % 7 != 0) {
-                pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq);
-                pawn_moves[MAXMOVES - 1]++;
-            } else {
-                // pawn promotions
-                pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::QUEEN);
-                pawn_moves[MAXMOVES - 1]++;
-                pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::ROOK);
-                pawn_moves[MAXMOVES - 1]++;
-                pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::KNIGHT);
-                pawn_moves[MAXMOVES - 1]++;
-                pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(start_sq, end_sq, ch_cst::BISHOP);
-                pawn_moves[MAXMOVES - 1]++;
-            }
-        } else if (BB::contains_square(pawns, end_sq - 2 * PAWN_DIR[ch.black_to_move])
-                && (!BB::contains_square(pinned_pieces, end_sq - 2 * PAWN_DIR[ch.black_to_move])
-                    || Compass::file_xindex(ch.find_king(ch.black_to_move)) == Compass::file_xindex(end_sq))) {
-            // double advances
-            pawn_moves[pawn_moves[MAXMOVES - 1]] = Move::build_move(end_sq - 2 * PAWN_DIR[ch.black_to_move], end_sq);
-            pawn_moves[MAXMOVES - 1]++;
+    U64 single = S::up(pawns) & ~ch.bb_occ;
+    U64 twice = S::up(single & S::THIRD_RANK) & ~ch.bb_occ & targets;
+    single &= targets;
+    // pinned pawns can only push when pinned along the king's file
+    U64 movable = pawns & ~(pinned_pieces & ~(0x0101010101010101ull << (king_sq & 7)));
+    count += BB::count_bits(single & S::up(movable) & ~S::LAST_RANK);
+    count += 4 * BB::count_bits(single & S::up(movable) & S::LAST_RANK);
+    count += BB::count_bits(twice & S::up(S::up(movable)));
+    return count;
+}
+
+/*
+ * An en passant capture removes two pawns from the board at once,
+ * which can expose the king to a slider the pin masks don't see.
+ * @param start_sq the square of the capturing pawn
+ * @return true if the capture would leave the king in check
+ */
+template<bool Black>
+bool MoveGenerator::ep_exposes_king(int start_sq) const {
+    int king_sq = ch.find_king(Black);
+    U64 op = Black ? ch.bb_white : ch.bb_black;
+    U64 victim = 1ull << (ch.ep_square - Side<Black>::UP);
+    U64 occ = ch.bb_occ & ~(1ull << start_sq) & ~victim | 1ull << ch.ep_square;
+    U64 en_rooks = (ch.bb_rooks | ch.bb_queens) & op;
+    U64 en_bishops = (ch.bb_bishops | ch.bb_queens) & op;
+    return Compass::rook_attacks(occ, king_sq) & en_rooks
+        || Compass::bishop_attacks(occ, king_sq) & en_bishops;
+}
+
+/*
+ * Method to check a move from outside the generator, such as a
+ * transposition table or killer move, straight against the bitboards.
+ * Relies on init() having been called for the position.
+ * @param mv the move to check, 0 is never legal
+ * @return true if gen_moves() would generate mv
+ */
+bool MoveGenerator::is_legal(move mv) const {
+    return ch.black_to_move ? legal_side<true>(mv) : legal_side<false>(mv);
+}
+
+template<bool Black>
+bool MoveGenerator::legal_side(move mv) const {
+    typedef Side<Black> S;
+    U64 own = Black ? ch.bb_black : ch.bb_white;
+    U64 op = Black ? ch.bb_white : ch.bb_black;
+    int start = Move::start(mv), end = Move::end(mv);
+    U64 from = 1ull << start, to = 1ull << end;
+    if (!(own & from) || own & to)
+        return false;
+    int piece = ch.piece_at(start);
+    int king_sq = ch.find_king(Black);
+
+    // pawns reaching the last rank must promote, nothing else may
+    if ((piece == ch_cst::PAWN && S::LAST_RANK & to) != (Move::promote(mv) != 0)
+            || Move::promote(mv) == ch_cst::PAWN || Move::promote(mv) > ch_cst::QUEEN)
+        return false;
+
+    if (piece == ch_cst::KING) {
+        if (Compass::king_attacks[start] & to)
+            return !(op_attack_mask & to);
+        // castling
+        // wh:QuKi bl:QuKi
+        if (end == start - 2)
+            return ch.castle_rights & S::QUEEN_CASTLE && !in_check
+                && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq - 1)
+                && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq - 2)
+                && !BB::contains_square(ch.bb_occ, king_sq - 3)
+                && BB::contains_square(ch.bb_rooks & own, king_sq - 4);
+        if (end == start + 2)
+            return ch.castle_rights & S::KING_CASTLE && !in_check
+                && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq + 1)
+                && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq + 2)
+                && BB::contains_square(ch.bb_rooks & own, king_sq + 3);
+        return false;
+    }
+
+    // only the king can answer a double check
+    if (in_double_check)
+        return false;
+    // pinned pieces stay on the line through their king
+    if (pinned_pieces & from && !(Compass::line[king_sq][start] & to))
+        return false;
+    // in check, every other piece must capture the checker or block
+    U64 targets = in_check ? check_ray : ~0ull;
+
+    switch (piece) {
+    case ch_cst::PAWN:
+        if (S::up_east(from) & to || S::up_west(from) & to) {
+            if (end != ch.ep_square)
+                return op & to & targets;
+            // an en passant capture may remove the checking pawn
+            return (targets & (to | 1ull << (end - S::UP))) && !ep_exposes_king<Black>(start);
         }
+        if (ch.bb_occ & to)
+            return false;
+        if (end == start + S::UP)
+            return targets & to;
+        return end == start + 2 * S::UP && S::up(from) & S::THIRD_RANK & ~ch.bb_occ && targets & to;
+    case ch_cst::KNIGHT:
+        return Compass::knight_attacks[start] & to & targets;
+    case ch_cst::BISHOP:
+        return Compass::bishop_attacks(ch.bb_occ, start) & to & targets;
+    case ch_cst::ROOK:
+        return Compass::rook_attacks(ch.bb_occ, start) & to & targets;
+    case ch_cst::QUEEN:
+        return Compass::queen_attacks(ch.bb_occ, start) & to & targets;
+    default:
+        return false;
     }
+}
 
-    if (!in_check)
-        return;
-    move legal_moves[MAXMOVES] = {};
-    for (int i = 0; i < pawn_moves[MAXMOVES - 1]; i++)
-        if (BB::contains_square(check_ray, Move::end(pawn_moves[i]))
-            || Move::end(pawn_moves[i]) == ch.ep_square
-                && check_ray & 1ull << ch.ep_square + directions::PAWN_DIR[!ch.black_to_move]) {
-            legal_moves[legal_moves[MAXMOVES - 1]] = pawn_moves[i];
-            legal_moves[MAXMOVES - 1]++;
+/*
+ * Method to tell which stage gen_stage() generates a move in
+ * @return true for captures, en passant captures and promotions
+ */
+bool MoveGenerator::is_capture(move mv) const {
+    return ch.piece_at(Move::end(mv)) || Move::promote(mv)
+        || Move::end(mv) == ch.ep_square && ch.piece_at(Move::start(mv)) == ch_cst::PAWN;
+}
+
+/*
+ * Method to tell if a legal move checks the opposing king,
+ * without making the move
+ * @param mv a legal move for the side to move
+ * @return true if the move gives direct or discovered check
+ */
+bool MoveGenerator::gives_check(move mv) const {
+    return ch.black_to_move ? check_side<true>(mv) : check_side<false>(mv);
+}
+
+template<bool Black>
+bool MoveGenerator::check_side(move mv) const {
+    typedef Side<Black> S;
+    U64 own = Black ? ch.bb_black : ch.bb_white;
+    int start = Move::start(mv), end = Move::end(mv);
+    U64 from = 1ull << start, to = 1ull << end;
+    int piece = Move::promote(mv) ? Move::promote(mv) : ch.piece_at(start);
+    int op_king_sq = ch.find_king(!Black);
+    U64 op_king = 1ull << op_king_sq;
+
+    // the board as it stands after the move, seen by our sliders
+    U64 occ = ch.bb_occ & ~from | to;
+    U64 diagonal = (ch.bb_bishops | ch.bb_queens) & own & ~from;
+    U64 straight = (ch.bb_rooks | ch.bb_queens) & own & ~from;
+
+    switch (piece) {
+    case ch_cst::PAWN:
+        if ((S::up_east(to) | S::up_west(to)) & op_king)
+            return true;
+        // en passant also takes the captured pawn off its rank
+        if (end == ch.ep_square && ch.piece_at(start) == ch_cst::PAWN)
+            occ &= ~(1ull << (end - S::UP));
+        break;
+    case ch_cst::KNIGHT:
+        if (Compass::knight_attacks[end] & op_king)
+            return true;
+        break;
+    case ch_cst::BISHOP:
+        diagonal |= to;
+        break;
+    case ch_cst::ROOK:
+        straight |= to;
+        break;
+    case ch_cst::QUEEN:
+        diagonal |= to;
+        straight |= to;
+        break;
+    case ch_cst::KING:
+        // castling checks with the rook
+        if (end == start + 2 || end == start - 2) {
+            U64 rook = 1ull << (end == start + 2 ? S::KING_ROOK : S::QUEEN_ROOK)
+                     | 1ull << (start + end) / 2;
+            occ ^= rook;
+            straight ^= rook;
         }
-    for (int i = 0; i < legal_moves[MAXMOVES - 1]; i++)
-        pawn_moves[i] = legal_moves[i];
-    pawn_moves[MAXMOVES - 1] = legal_moves[MAXMOVES - 1];
+        break;
+    }
+
+    // direct checks by a slider and discovered checks both
+    // show up as a slider seen from the opposing king
+    return Compass::bishop_attacks(occ, op_king_sq) & diagonal
+        || Compass::rook_attacks(occ, op_king_sq) & straight;
 }
 
-void MoveGenerator::gen_knight_piece_moves(move (&knight_moves)[MAXMOVES], int start, bool test) {
-    U64 ts = Compass::knight_attacks[start] & ~*ch.bb_color[ch.black_to_move];
+void MoveGenerator::gen_knight_piece_moves(MoveList& moves, int start, U64 targets, bool test) {
     if (BB::contains_square(pinned_pieces, start))
         return;
+    U64 ts = Compass::knight_attacks[start] & targets;
 
     while (ts) {
-        // x & -x masks the LS1B
-        knight_moves[knight_moves[MAXMOVES - 1]] = Move::build_move(start, 63 - BB::lz_count(ts & 0-ts));
-        knight_moves[MAXMOVES - 1]++;
+        // square of the LS1B
+        moves.add(Move::build_move(start, BB::lsb(ts)));
         // now clear that LS1B
         ts &= ts - 1;
     }
-
-    if (!in_check)
-        return;
-    move legal_moves[MAXMOVES] = {};
-    for (int i = 0; i < knight_moves[MAXMOVES - 1]; i++)
-        if (check_ray & 1ull << Move::end(knight_moves[i])) {
-            legal_moves[legal_moves[MAXMOVES - 1]] = knight_moves[i];
-            legal_moves[MAXMOVES - 1]++;
-        }
-    for (int i = 0; i < legal_moves[MAXMOVES - 1]; i++)
-        knight_moves[i] = legal_moves[i];
-    knight_moves[MAXMOVES - 1] = legal_moves[MAXMOVES - 1];
 }
 
-void MoveGenerator::gen_bishop_piece_moves(move (&bishop_moves)[MAXMOVES], int start, bool test) {
-    bishop_moves[MAXMOVES] = {};
-    U64 ss = 1ull << start;
-    U64 ts = BB::NoEa_attacks(ss, ~ch.bb_occ);
-    ts |= BB::NoWe_attacks(ss, ~ch.bb_occ);
-    ts |= BB::SoEa_attacks(ss, ~ch.bb_occ);
-    ts |= BB::SoWe_attacks(ss, ~ch.bb_occ);
-    ts &= *ch.bb_color[!ch.black_to_move] | ~ch.bb_occ;
+void MoveGenerator::gen_bishop_piece_moves(MoveList& moves, int start, int king_sq, U64 targets, bool test) {
+    U64 ts = Compass::bishop_attacks(ch.bb_occ, start) & targets;
+    // pinned pieces stay on the line through their king
+    if (BB::contains_square(pinned_pieces, start))
+        ts &= Compass::line[king_sq][start];
 
     while (ts) {
-        // x & -x masks the LS1B
-        if (~pinned_pieces & ss || Compass::ray_square(ch.find_king(ch.black_to_move), start) & ts & 0-ts) {
-            bishop_moves[bishop_moves[MAXMOVES - 1]] = Move::build_move(start, 63 - BB::lz_count(ts & 0-ts));
-            bishop_moves[MAXMOVES - 1]++;
-        }
+        // square of the LS1B
+        moves.add(Move::build_move(start, BB::lsb(ts)));
         // now clear that LS1B
         ts &= ts - 1;
     }
-
-    if (!in_check)
-        return;
-    move legal_moves[MAXMOVES] = {};
-    for (int i = 0; i < bishop_moves[MAXMOVES - 1]; i++)
-        if (BB::contains_square(check_ray, Move::end(bishop_moves[i]))) {
-            legal_moves[legal_moves[MAXMOVES - 1]] = bishop_moves[i];
-            legal_moves[MAXMOVES - 1]++;
-        }
-    for (int i = 0; i < legal_moves[MAXMOVES - 1]; i++)
-        bishop_moves[i] = legal_moves[i];
-    bishop_moves[MAXMOVES - 1] = legal_moves[MAXMOVES - 1];
 }
 
-void MoveGenerator::gen_rook_piece_moves(move (&rook_moves)[MAXMOVES], int start, bool test) {
-    U64 ss = 1ull << start;
-    U64 ts = BB::nort_attacks(ss, ~ch.bb_occ);
-    ts |= BB::sout_attacks(ss, ~ch.bb_occ);
-    ts |= BB::east_attacks(ss, ~ch.bb_occ);
-    ts |= BB::west_attacks(ss, ~ch.bb_occ);
-    ts &= *ch.bb_color[!ch.black_to_move] | ~ch.bb_occ;
+void MoveGenerator::gen_rook_piece_moves(MoveList& moves, int start, int king_sq, U64 targets, bool test) {
+    U64 ts = Compass::rook_attacks(ch.bb_occ, start) & targets;
+    // pinned pieces stay on the line through their king
+    if (BB::contains_square(pinned_pieces, start))
+        ts &= Compass::line[king_sq][start];
 
-    // ignore pinned pieces
     while (ts)
     {
-        // x & -x masks the LS1B
-        if (~pinned_pieces & ss || Compass::ray_square(ch.find_king(ch.black_to_move), start) & ts & 0-ts) {
-            rook_moves[rook_moves[MAXMOVES - 1]] = Move::build_move(start, 63 - BB::lz_count(ts & 0-ts));
-            rook_moves[MAXMOVES - 1]++;
-        }
+        // square of the LS1B
+        moves.add(Move::build_move(start, BB::lsb(ts)));
         // now clear that LS1B
         ts &= ts - 1;
     }
-
-    if (!in_check)
-        return;
-    move legal_moves[MAXMOVES] = {};
-    for (int i = 0; i < rook_moves[MAXMOVES - 1]; i++)
-        if (BB::contains_square(check_ray, Move::end(rook_moves[i]))) {
-            legal_moves[legal_moves[MAXMOVES - 1]] = rook_moves[i];
-            legal_moves[MAXMOVES - 1]++;
-        }
-    for (int i = 0; i < legal_moves[MAXMOVES - 1]; i++)
-        rook_moves[i] = legal_moves[i];
-    rook_moves[MAXMOVES - 1] = legal_moves[MAXMOVES - 1];
 }
 
-void MoveGenerator::gen_king_piece_moves(move (&king_moves)[MAXMOVES], bool test) {
-    int king_sq = ch.find_king(ch.black_to_move);
+template<bool Black>
+void MoveGenerator::gen_king_piece_moves(MoveList& moves, int kinds, bool test) {
+    U64 own = Black ? ch.bb_black : ch.bb_white;
+    U64 op = Black ? ch.bb_white : ch.bb_black;
+    int king_sq = ch.find_king(Black);
+    U64 targets = (kinds & GEN_CAPTURES ? op : 0ull)
+                | (kinds & GEN_QUIETS ? ~ch.bb_occ : 0ull);
     U64 ts = Compass::king_attacks[king_sq]
-           & ~*ch.bb_color[ch.black_to_move]
+           & targets
            & ~op_attack_mask;
 
     // normal moves
     while (ts) {
-        // x & -x masks the LS1B
-        king_moves[king_moves[MAXMOVES - 1]] = Move::build_move(king_sq, 63 - BB::lz_count(ts & 0-ts));
-        king_moves[MAXMOVES - 1]++;
+        // square of the LS1B
+        moves.add(Move::build_move(king_sq, BB::lsb(ts)));
         // now clear that LS1B
         ts &= ts - 1;
     }
 
     // castling
     // wh:QuKi bl:QuKi
+    if (!(kinds & GEN_QUIETS))
+        return;
     // queenside castle
-    if (ch.castle_rights & 2 << 2 * ch.black_to_move && !in_check
+    if (ch.castle_rights & Side<Black>::QUEEN_CASTLE && !in_check
             && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq - 1)
             && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq - 2)
             && !BB::contains_square(ch.bb_occ, king_sq - 3)
-            && BB::contains_square(ch.bb_rooks & *ch.bb_color[ch.black_to_move], king_sq - 4)) {
-        king_moves[king_moves[MAXMOVES - 1]] = Move::build_move(king_sq, king_sq - 2);
-        king_moves[MAXMOVES - 1]++;
+            && BB::contains_square(ch.bb_rooks & own, king_sq - 4)) {
+        moves.add(Move::build_move(king_sq, king_sq - 2));
     }
     // kingside castle
-    if (ch.castle_rights & 1 << 2 * ch.black_to_move && !in_check
+    if (ch.castle_rights & Side<Black>::KING_CASTLE && !in_check
             && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq + 1)
             && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq + 2)
-            && BB::contains_square(ch.bb_rooks & *ch.bb_color[ch.black_to_move], king_sq + 3)) {
-        king_moves[king_moves[MAXMOVES - 1]] = Move::build_move(king_sq, king_sq + 2);
-        king_moves[MAXMOVES - 1]++;
+            && BB::contains_square(ch.bb_rooks & own, king_sq + 3)) {
+        moves.add(Move::build_move(king_sq, king_sq + 2));
     }
 }
 
+/*
+ * Counts legal king moves, including castles
+ */
+template<bool Black>
+int MoveGenerator::count_king_moves(bool test) {
+    U64 own = Black ? ch.bb_black : ch.bb_white;
+    int king_sq = ch.find_king(Black);
+    int count = BB::count_bits(Compass::king_attacks[king_sq]
+           & ~own
+           & ~op_attack_mask);
+
+    // castling
+    // wh:QuKi bl:QuKi
+    // queenside castle
+    count += ch.castle_rights & Side<Black>::QUEEN_CASTLE && !in_check
+            && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq - 1)
+            && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq - 2)
+            && !BB::contains_square(ch.bb_occ, king_sq - 3)
+            && BB::contains_square(ch.bb_rooks & own, king_sq - 4);
+    // kingside castle
+    count += ch.castle_rights & Side<Black>::KING_CASTLE && !in_check
+            && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq + 1)
+            && !BB::contains_square(ch.bb_occ | op_attack_mask, king_sq + 2)
+            && BB::contains_square(ch.bb_rooks & own, king_sq + 3);
+    return count;
+}
+
 /*
  * Method to write the SAN string of a move in the current position.
  * @param mv the Move to write
@@ -517,15 +739,14 @@ void MoveGenerator::gen_king_piece_moves(move (&king_moves)[MAXMOVES], bool test
 std::string MoveGenerator::move_san(move mv) {
     Chess ch = *Chess::state();
     MoveGenerator san_gen(ch);
-    move moves[MAXMOVES] = {};
+    MoveList moves;
     san_gen.gen_moves(moves);
     std::string san = "";
     int start = Move::start(mv), end = Move::end(mv);
     int piece = ch.piece_at(start);
 
     // check for ambiguity
-    for (int i = 0; i < moves[MAXMOVES-1]; i++) {
-        move m2 = moves[i];
+    for (move m2 : moves) {
         if (Move::start(m2) == start || Move::end(m2) != end || ch.piece_at(Move::start(m2)) != piece)
             continue;
         if (Compass::file_xindex(Move::start(m2)) != Compass::file_xindex(start))
@@ -560,14 +781,12 @@ std::string MoveGenerator::move_san(move mv) {
             san += "-O";
     }
 
-    // check
-    Chess::push_move(mv);
-    MoveGenerator check_gen(Chess::state());
-    check_gen.init(false);
-    check_gen.gen_moves(moves);
-    if (check_gen.in_check)
-        san += !moves[MAXMOVES-1] ? "#" : "+";
-    Chess::unmake_move(1);
+    // check, the move is only made to tell mate from check
+    if (san_gen.gives_check(mv)) {
+        Chess::push_move(mv);
+        san += MoveGenerator(Chess::state()).count_moves() ? "+" : "#";
+        Chess::unmake_move(1);
+    }
 
     return san;
 }
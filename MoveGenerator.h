@@ -13,25 +13,46 @@ public:
     inline MoveGenerator(Chess* ptr) : ch(*ptr) {}
     inline MoveGenerator(Chess& pos) : ch(pos) {}
     Chess& ch;
+    // kinds of moves gen_stage can generate
+    // captures include en passant and every promotion
+    static const int GEN_CAPTURES = 1;
+    static const int GEN_QUIETS = 2;
+    static const int GEN_ALL = GEN_CAPTURES | GEN_QUIETS;
     bool is_game_over(bool test);
-    move* gen_moves(move (&moves)[MAXMOVES], bool test = false);
-    void checks_exist(bool test);
+    MoveList& gen_moves(MoveList& moves, bool test = false);
+    MoveList& gen_stage(MoveList& moves, int kinds, bool test = false);
+    int count_moves(bool test = false);
+    bool is_legal(move mv) const;
+    bool is_capture(move mv) const;
+    bool gives_check(move mv) const;
     bool in_check = false;
     bool in_double_check = false;
     U64 gen_op_attack_mask(bool test);
     U64 pinned_pieces;
     void init(bool test);
+    static const AttackInfo& attack_info(Chess& pos, bool both_sides = false, bool test = false);
     static std::string move_san(move mv);
     U64 check_ray;
     U64 op_attack_mask;
 private:
-    void gen_pawn_moves(move (&pawn_moves)[MAXMOVES], bool test);
-    void gen_knight_piece_moves(move (&knight_moves)[MAXMOVES], int sq, bool test);
-    void gen_bishop_piece_moves(move (&bishop_moves)[MAXMOVES], int sq, bool test);
-    void gen_rook_piece_moves(move (&rook_moves)[MAXMOVES], int sq, bool test);
-    void gen_king_piece_moves(move (&king_moves)[MAXMOVES], bool test);
-    U64 find_pins(bool test);
-    void check_method();
+    // the side to move is a template parameter from here on,
+    // so each color gets its own branch-free copy
+    template<bool Black> void fill_attack_info(bool test);
+    template<bool Black> U64 checks_exist(bool test);
+    template<bool Black> U64 find_pins(bool test);
+    template<bool Black> U64 op_attacks() const;
+    template<bool Black> void gen_side(MoveList& moves, int kinds, bool test);
+    template<bool Black> int count_side(bool test);
+    template<bool Black> void gen_pawn_moves(MoveList& moves, int kinds, bool test);
+    template<bool Black> void gen_king_piece_moves(MoveList& moves, int kinds, bool test);
+    template<bool Black> int count_pawn_moves(U64 targets, bool test);
+    template<bool Black> int count_king_moves(bool test);
+    template<bool Black> bool ep_exposes_king(int start_sq) const;
+    template<bool Black> bool legal_side(move mv) const;
+    template<bool Black> bool check_side(move mv) const;
+    void gen_knight_piece_moves(MoveList& moves, int sq, U64 targets, bool test);
+    void gen_bishop_piece_moves(MoveList& moves, int sq, int king_sq, U64 targets, bool test);
+    void gen_rook_piece_moves(MoveList& moves, int sq, int king_sq, U64 targets, bool test);
 };
 
 #endif
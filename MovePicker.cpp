@@ -0,0 +1,96 @@
+#include "MovePicker.h"
+
+/*
+ * @param pos the position to pick moves in
+ * @param tt_move the best move stored for this position, 0 if none
+ * @param killers quiet moves that caused cutoffs at this ply
+ * Moves from outside the generator are checked before they are used,
+ * so a hash collision can't play an illegal move.
+ */
+MovePicker::MovePicker(Chess& pos, move tt_move, const move (&killers)[2]) : gen(pos) {
+    gen.init(false);
+    this->tt_move = gen.is_legal(tt_move) ? tt_move : 0;
+    this->killers[0] = killers[0];
+    this->killers[1] = killers[1];
+}
+
+/*
+ * A picker for quiescence search, which only hands out
+ * the TT move if it is a capture, then captures by MVV-LVA
+ * @param pos the position to pick moves in
+ * @param tt_move the best move stored for this position, 0 if none
+ */
+MovePicker::MovePicker(Chess& pos, move tt_move) : gen(pos), captures_only(true) {
+    gen.init(false);
+    this->tt_move = gen.is_legal(tt_move) && gen.is_capture(tt_move) ? tt_move : 0;
+    killers[0] = killers[1] = 0;
+}
+
+/*
+ * Method to get the next move to search
+ * @return the next legal move, or 0 once every move has been picked
+ */
+move MovePicker::next() {
+    switch (stage) {
+    case STAGE_TT:
+        stage = STAGE_GEN_CAPTURES;
+        if (tt_move)
+            return tt_move;
+        // fall through
+    case STAGE_GEN_CAPTURES:
+        gen.gen_stage(moves, MoveGenerator::GEN_CAPTURES);
+        // most valuable victim, least valuable attacker
+        // promotions count the new piece as part of the victim
+        for (int i = 0; i < moves.size(); i++) {
+            int victim = gen.ch.piece_at(Move::end(moves[i]));
+            victim = victim || Move::end(moves[i]) != gen.ch.ep_square ? victim : ch_cst::PAWN;
+            moves.scores[i] = 8 * (victim + Move::promote(moves[i])) - gen.ch.piece_at(Move::start(moves[i]));
+        }
+        cursor = 0;
+        stage = STAGE_CAPTURES;
+        // fall through
+    case STAGE_CAPTURES:
+        while (cursor < moves.size()) {
+            // bring the best remaining capture forward
+            int best = cursor;
+            for (int i = cursor + 1; i < moves.size(); i++)
+                best = moves.scores[i] > moves.scores[best] ? i : best;
+            std::swap(moves[cursor], moves[best]);
+            std::swap(moves.scores[cursor], moves.scores[best]);
+            move mv = moves[cursor++];
+            if (mv != tt_move)
+                return mv;
+        }
+        if (captures_only) {
+            stage = STAGE_DONE;
+            return 0;
+        }
+        stage = STAGE_KILLERS;
+        // fall through
+    case STAGE_KILLERS:
+        // killers are played before the quiets are generated,
+        // if they are legal quiet moves here
+        while (killer_idx < 2) {
+            move mv = killers[killer_idx++];
+            if (mv != tt_move && gen.is_legal(mv) && !gen.is_capture(mv))
+                return mv;
+        }
+        stage = STAGE_GEN_QUIETS;
+        // fall through
+    case STAGE_GEN_QUIETS:
+        gen.gen_stage(moves, MoveGenerator::GEN_QUIETS);
+        cursor = 0;
+        stage = STAGE_QUIETS;
+        // fall through
+    case STAGE_QUIETS:
+        while (cursor < moves.size()) {
+            move mv = moves[cursor++];
+            if (mv != tt_move && mv != killers[0] && mv != killers[1])
+                return mv;
+        }
+        stage = STAGE_DONE;
+        // fall through
+    default:
+        return 0;
+    }
+}
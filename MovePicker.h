@@ -0,0 +1,34 @@
+// Staged move ordering for alpha-beta search
+#ifndef MOVEPICKER_H
+#define MOVEPICKER_H
+
+#include "MoveGenerator.h"
+
+/*
+ * Hands out the legal moves of a position one at a time, best guesses first:
+ * the transposition table move, captures and promotions by MVV-LVA,
+ * killer moves, then quiet moves.
+ * Each stage is generated only once the one before it runs out,
+ * so a cutoff on an early move skips the rest of the generation.
+ * The TT move and killers need no generation at all.
+ */
+class MovePicker {
+public:
+    MovePicker(Chess& pos, move tt_move, const move (&killers)[2]);
+    MovePicker(Chess& pos, move tt_move);
+    move next();
+    inline bool has_tt_move() const { return tt_move; }
+    MoveGenerator gen;
+private:
+    enum Stage { STAGE_TT, STAGE_GEN_CAPTURES, STAGE_CAPTURES, STAGE_KILLERS,
+        STAGE_GEN_QUIETS, STAGE_QUIETS, STAGE_DONE };
+    int stage = STAGE_TT;
+    bool captures_only = false;
+    move tt_move;
+    move killers[2];
+    int killer_idx = 0;
+    MoveList moves;
+    int cursor = 0;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "PerftPool.h"
+
+PerftPool::PerftPool(int threads) {
+    thread_count = threads > 0 ? threads : std::thread::hardware_concurrency();
+    thread_count = thread_count > 0 ? thread_count : 1;
+    for (int i = 0; i < thread_count; i++)
+        workers.push_back(std::make_unique<Worker>());
+}
+
+/*
+ * Multi-threaded PERformance Test of the current position
+ * Subtrees deeper than split_depth are split into tasks which
+ * idle workers steal from the front of each other's queues.
+ * @param depth number of ply to search
+ * @return the number of leaf nodes found at depth
+ */
+U64 PerftPool::run(int depth) {
+    Chess root(*Chess::state());
+    if (!depth)
+        return 1;
+
+    for (auto& w : workers) {
+        w->tasks.clear();
+        w->nodes = 0;
+        w->leaf_nodes = 0;
+        w->steals = 0;
+    }
+    pending = 1;
+    workers[0]->tasks.push_back(PerftTask{ {}, depth });
+
+    fmt::print("Starting parallel perft({}) on {} threads at {}\n",
+        depth, thread_count, SearchLogger::time_to_string());
+    Timer perft_timer;
+    std::vector<std::thread> threads;
+    for (int id = 0; id < thread_count; id++)
+        threads.emplace_back(&PerftPool::work, this, id, std::cref(root));
+    for (std::thread& t : threads)
+        t.join();
+    double elapsed = perft_timer.elapsed();
+
+    // test finished, print results
+    U64 nodes = 0;
+    U64 leaf_nodes = 0;
+    for (int id = 0; id < thread_count; id++) {
+        Worker& w = *workers[id];
+        fmt::print("thread {:>2}: {:>14} nodes {:>12.0f} nodes/s {:>8} steals\n",
+            id, w.nodes, elapsed >= 0.001 ? w.nodes / elapsed : (double) w.nodes, w.steals);
+        nodes += w.nodes;
+        leaf_nodes += w.leaf_nodes;
+    }
+    fmt::print("{}: search finished in {}s at {:.0f} nodes/s\n{} leaf nodes found at depth {}.\n",
+        SearchLogger::time_to_string(), elapsed, elapsed >= 0.001 ? nodes / elapsed : (double) nodes,
+        leaf_nodes, depth);
+    return leaf_nodes;
+}
+
+/*
+ * Worker thread loop
+ * Each worker replays a task's moves on its own position stack,
+ * then either splits the task or counts the subtree.
+ */
+void PerftPool::work(int id, const Chess& root) {
+    Worker& w = *workers[id];
+    Chess::stack.reset(root);
+    PerftTask task;
+    while (pending) {
+        if (!pop_task(id, task) && !steal_task(id, task)) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (move mv : task.path)
+            Chess::push_move(mv);
+
+        if (task.depth > split_depth) {
+            MoveGenerator split_gen(Chess::state());
+            MoveList moves;
+            split_gen.gen_moves(moves);
+            pending += moves.size();
+            for (int mvidx = 0; mvidx < moves.size(); mvidx++) {
+                PerftTask child{ task.path, task.depth - 1 };
+                child.path.push_back(moves[mvidx]);
+                push_task(id, std::move(child));
+            }
+            w.nodes += moves.size();
+        } else {
+            U64 nodes = 0;
+            U64 leaf_nodes = perft(task.depth, nodes);
+            w.nodes += nodes;
+            w.leaf_nodes += leaf_nodes;
+        }
+
+        Chess::unmake_move(task.path.size());
+        pending--;
+    }
+}
+
+void PerftPool::push_task(int id, PerftTask task) {
+    std::lock_guard<std::mutex> guard(workers[id]->lock);
+    workers[id]->tasks.push_back(std::move(task));
+}
+
+// take the newest (smallest) task from our own queue
+bool PerftPool::pop_task(int id, PerftTask& task) {
+    Worker& w = *workers[id];
+    std::lock_guard<std::mutex> guard(w.lock);
+    if (w.tasks.empty())
+        return false;
+    task = std::move(w.tasks.back());
+    w.tasks.pop_back();
+    return true;
+}
+
+// take the oldest (largest) task from another worker's queue
+bool PerftPool::steal_task(int id, PerftTask& task) {
+    for (int i = 1; i < thread_count; i++) {
+        Worker& victim = *workers[(id + i) % thread_count];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.tasks.empty())
+            continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        workers[id]->steals++;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Single-threaded perft of one task's subtree
+ * @param depth number of ply remaining in the search
+ * @param nodes U64& to count the number of positions searched
+ */
+U64 PerftPool::perft(int depth, U64& nodes) {
+    if (!depth)
+        return 1;
+    U64 leaf_nodes = 0;
+    MoveGenerator perft_gen(Chess::state());
+    // bulk-count the frontier
+    if (depth == 1) {
+        leaf_nodes = perft_gen.count_moves();
+        nodes += leaf_nodes;
+        return leaf_nodes;
+    }
+    MoveList moves;
+    perft_gen.gen_moves(moves);
+    Chess& ch = *Chess::state();
+    for (int mvidx = 0; mvidx < moves.size(); mvidx++) {
+        Undo undo = ch.do_move(moves[mvidx]);
+        nodes++;
+        leaf_nodes += perft(depth - 1, nodes);
+        ch.undo_move(moves[mvidx], undo);
+    }
+    return leaf_nodes;
+}
@@ -0,0 +1,47 @@
+// Work-stealing thread pool for multi-threaded perft
+#ifndef PERFTPOOL_H
+#define PERFTPOOL_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Chess.h"
+#include "MoveGenerator.h"
+
+/*
+ * A subtree of the perft tree:
+ * the moves played from the root position and the remaining depth
+ */
+struct PerftTask {
+    std::vector<move> path;
+    int depth;
+};
+
+class PerftPool {
+public:
+    PerftPool(int thread_count = 0);
+    U64 run(int depth);
+    int thread_count;
+    // subtrees deeper than this are split into one task per move
+    int split_depth = 3;
+    static U64 perft(int depth, U64& nodes);
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<PerftTask> tasks;
+        U64 nodes = 0;
+        U64 leaf_nodes = 0;
+        U64 steals = 0;
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<U64> pending;
+    void work(int id, const Chess& root);
+    void push_task(int id, PerftTask task);
+    bool pop_task(int id, PerftTask& task);
+    bool steal_task(int id, PerftTask& task);
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "PerftSuite.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+/*
+ * Load a perft suite from an EPD file
+ * Each line holds a FEN followed by ";D<depth> <leaf nodes>" fields.
+ * Blank lines and lines starting with '#' are skipped.
+ * @param path the EPD file to read
+ */
+PerftSuite::PerftSuite(std::string path) {
+    std::ifstream epd(path);
+    if (!epd)
+        fmt::print("Could not open perft suite {}\n", path);
+    std::string line;
+    while (std::getline(epd, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::stringstream fields(line);
+        std::string field;
+        std::getline(fields, field, ';');
+        PerftRecord record;
+        record.fen = field.substr(0, field.find_last_not_of(" \t\r") + 1);
+        // EPD positions may leave out the move clocks
+        if (std::count(record.fen.begin(), record.fen.end(), ' ') < 4)
+            record.fen += " 0 1";
+        while (std::getline(fields, field, ';')) {
+            int depth = 0;
+            unsigned long long leaf_nodes = 0;
+            if (std::sscanf(field.c_str(), " D%d %llu", &depth, &leaf_nodes) == 2)
+                record.expected.push_back({ depth, (U64) leaf_nodes });
+        }
+        records.push_back(record);
+    }
+}
+
+/*
+ * Run every position of the suite, one position per thread at a time
+ * @param thread_count number of threads, defaults to every core
+ * @return true if every position matched its expected counts
+ */
+bool PerftSuite::run(int thread_count) {
+    thread_count = thread_count > 0 ? thread_count : std::thread::hardware_concurrency();
+    thread_count = thread_count > 0 ? thread_count : 1;
+    next_record = 0;
+    fmt::print("Starting perft suite of {} positions on {} threads at {}\n",
+        records.size(), thread_count, SearchLogger::time_to_string());
+
+    Timer suite_timer;
+    std::vector<std::thread> threads;
+    for (int id = 0; id < thread_count; id++)
+        threads.emplace_back(&PerftSuite::work, this);
+    for (std::thread& t : threads)
+        t.join();
+    double elapsed = suite_timer.elapsed();
+
+    // suite finished, print results
+    int passed = 0;
+    U64 nodes = 0;
+    for (const PerftRecord& record : records) {
+        passed += record.passed;
+        nodes += record.nodes;
+    }
+    fmt::print("{}: suite finished in {}s at {:.0f} nodes/s\n{}/{} positions passed. {}\n",
+        SearchLogger::time_to_string(), elapsed, elapsed >= 0.001 ? nodes / elapsed : (double) nodes,
+        passed, records.size(), passed == (int) records.size() ? "Nice!" : "Uh oh!");
+    return !records.empty() && passed == (int) records.size();
+}
+
+void PerftSuite::work() {
+    for (int idx = next_record++; idx < (int) records.size(); idx = next_record++)
+        run_record(idx);
+}
+
+/*
+ * Run perft on one position at each of its listed depths
+ * @param idx the index of the record to test
+ */
+void PerftSuite::run_record(int idx) {
+    PerftRecord& record = records[idx];
+    Chess::stack.reset(Chess(record.fen));
+
+    std::string results = "";
+    Timer record_timer;
+    for (auto& expected : record.expected) {
+        U64 leaf_nodes = PerftPool::perft(expected.first, record.nodes);
+        results += fmt::format(" D{} {}", expected.first, leaf_nodes);
+        if (leaf_nodes != expected.second) {
+            results += fmt::format(" ({} expected)", expected.second);
+            record.passed = false;
+        }
+    }
+    record.time = record_timer.elapsed();
+
+    std::lock_guard<std::mutex> guard(print_lock);
+    fmt::print("{:>3}/{}: {} {:>7.3f}s {:>10.0f} nodes/s{}\n\t{}\n",
+        idx + 1, records.size(), record.passed ? "pass" : "FAIL", record.time,
+        record.time >= 0.001 ? record.nodes / record.time : (double) record.nodes, results, record.fen);
+}
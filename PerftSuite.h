@@ -0,0 +1,35 @@
+// Perft regression and throughput suite read from an EPD file
+#ifndef PERFTSUITE_H
+#define PERFTSUITE_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "PerftPool.h"
+
+/*
+ * One EPD record: a position and its
+ * expected leaf counts at each listed depth
+ */
+struct PerftRecord {
+    std::string fen;
+    std::vector<std::pair<int, U64>> expected;
+    bool passed = true;
+    U64 nodes = 0;
+    double time = 0;
+};
+
+class PerftSuite {
+public:
+    PerftSuite(std::string path);
+    bool run(int thread_count = 0);
+    std::vector<PerftRecord> records;
+private:
+    std::atomic<int> next_record;
+    std::mutex print_lock;
+    void work();
+    void run_record(int idx);
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "PerftTable.h"
+
+/*
+ * @param mb the table size in megabytes,
+ *        rounded down to a power of two number of entries
+ */
+PerftTable::PerftTable(int mb) {
+    U64 entries = 1;
+    U64 max_entries = ((U64) (mb > 0 ? mb : 1) << 20) / sizeof(PerftEntry);
+    while (entries * 2 <= max_entries)
+        entries *= 2;
+    table.resize(entries);
+    mask = entries - 1;
+}
+
+/*
+ * Method to look up the leaf count of a subtree
+ * @param key zhash of the subtree's root position
+ * @param depth remaining depth of the subtree
+ * @param count set to the leaf count when found
+ * @return true if the subtree was found
+ */
+bool PerftTable::probe(U64 key, int depth, U64& count) {
+    probes++;
+    const PerftEntry& e = table[key & mask];
+    if (e.key != key || (int) (e.depth_count >> COUNT_BITS) != depth)
+        return false;
+    hits++;
+    count = e.depth_count & COUNT_MASK;
+    return true;
+}
+
+/*
+ * Method to record the leaf count of a subtree
+ * Always replaces the previous entry at that index.
+ */
+void PerftTable::store(U64 key, int depth, U64 count) {
+    PerftEntry& e = table[key & mask];
+    e.key = key;
+    e.depth_count = (U64) depth << COUNT_BITS | (count & COUNT_MASK);
+}
+
+float PerftTable::hit_rate() const {
+    return probes ? (float) hits / probes : 0.0f;
+}
+
+size_t PerftTable::size_mb() const {
+    return table.size() * sizeof(PerftEntry) >> 20;
+}
@@ -0,0 +1,34 @@
+// Leaf count cache for hashed perft, kept apart from the search TTable
+#ifndef PERFTTABLE_H
+#define PERFTTABLE_H
+
+#include <vector>
+#include "Bitboard.h"
+
+/*
+ * One cached subtree: the position's zhash, and the
+ * remaining depth packed above the leaf count
+ */
+struct PerftEntry {
+    U64 key = 0;
+    U64 depth_count = 0;
+};
+
+class PerftTable {
+public:
+    PerftTable(int mb = DEFAULT_MB);
+    static const int DEFAULT_MB = 256;
+    static const int COUNT_BITS = 56;
+    static const U64 COUNT_MASK = (1ull << COUNT_BITS) - 1;
+    bool probe(U64 key, int depth, U64& count);
+    void store(U64 key, int depth, U64 count);
+    float hit_rate() const;
+    size_t size_mb() const;
+    U64 probes = 0;
+    U64 hits = 0;
+private:
+    std::vector<PerftEntry> table;
+    U64 mask;
+};
+
+#endif
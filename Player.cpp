@@ -12,27 +12,32 @@ Player::Player(float mob_percent) : search_log("iter_search_log", 0) {
  * @return the best move found in the search
  */
 move Player::iterative_search(int depth, U64& nodes, bool test) {
-    move moves[MAXMOVES] = {};
+    MoveList moves;
     MoveGenerator mgen(Chess::state());
     mgen.gen_moves(moves);
     bool extended = false;
     // extend search in pawn endgames
     if (best_piece() == ch_cst::PAWN) depth += 2;
     // depth += BB::count_bits(Chess::state()->bb_occ) < 6;
-    // if (TTable::fill_ratio() > 0.7) TTable::clear();
+
+    // older entries stay in the table, but make way for this search's
+    TTable::new_search();
+    // killers are indexed by ply from the root of this search
+    root_keys = Chess::stack.key_count;
+    std::fill(&killers[0][0], &killers[0][0] + 2 * MAX_SEARCH_PLY, (move) 0);
 
     fmt::print("Beginning search at depth ");
     for (int iter = 1; iter <= depth; iter++) {
         fmt::print("{} . . . ", iter);
         float high_score = -99.99f;
-        for (int mvidx = 0; mvidx < moves[MAXMOVES - 1]; mvidx++) {
-            Chess::push_move(moves[mvidx]);
+        for (int mvidx = 0; mvidx < moves.size(); mvidx++) {
+            Undo undo = Chess::state()->do_move(moves[mvidx]);
             float score = -nega_max(iter - 1, nodes, -99.99f, -high_score, test);
-            Chess::unmake_move(1);
+            Chess::state()->undo_move(moves[mvidx], undo);
             // print output of search
             if (test && iter == depth)
                 fmt::print("\n{:>2d}/{}: {:<6} {:0.2f}",
-                    mvidx + 1, moves[MAXMOVES - 1], MoveGenerator::move_san(moves[mvidx]), score);
+                    mvidx + 1, moves.size(), MoveGenerator::move_san(moves[mvidx]), score);
             Move::arr_shift_right(moves, score > high_score ? mvidx : 0);
             high_score = score > high_score ? score : high_score;
         }
@@ -56,15 +61,8 @@ move Player::iterative_search(int depth, U64& nodes, bool test) {
  */
 float Player::nega_max(int depth, U64& nodes, float alpha, float beta, bool test) {
     Chess& ch = *Chess::state();
-    MoveGenerator mgen(ch);
-    move moves[MAXMOVES] = {};
-    mgen.gen_moves(moves);
     nodes++;
 
-    // check for mate
-    if (!moves[MAXMOVES - 1])
-        return eval(depth);
-
     // check for threefold repition
     if (ch.repetitions() > 2)
         return 0.0f;
@@ -72,14 +70,14 @@ float Player::nega_max(int depth, U64& nodes, float alpha, float beta, bool test
     Entry prev = TTable::probe(ch.zhash);
     // if the stored depth was >= remaining search depth, use that result
     if (prev.depth >= depth) {
-        TTable::hits++;
+        TTable::stats.hits++;
         if (prev.flag == Entry::FLAG_EXACT)
             return prev.score;
         else if (prev.flag == Entry::FLAG_ALPHA && prev.score <= alpha)
             return alpha;
         else if (prev.flag == Entry::FLAG_BETA && prev.score >= beta)
             return beta;
-        TTable::hits--;
+        TTable::stats.hits--;
     }
 
     // end of normal search, begin quiesence search
@@ -90,26 +88,39 @@ float Player::nega_max(int depth, U64& nodes, float alpha, float beta, bool test
         return score;
     }
 
-    // prioritize searching previous best moves
-    move best = 0;
-    if (prev.best) {
-        TTable::hits++;
-        int best_pos = 0;
-        while (moves[best_pos] != prev.best)
-            best_pos++;
-        Move::arr_shift_right(moves, best_pos);
-    }
+    // the picker tries previous best moves first
+    if (prev.best)
+        TTable::stats.hits++;
+    int ply = Chess::stack.key_count - root_keys;
+    ply = ply < MAX_SEARCH_PLY ? ply : MAX_SEARCH_PLY - 1;
+    MovePicker picker(ch, prev.best, killers[ply]);
 
-    for (int mvidx = 0; mvidx < moves[MAXMOVES - 1]; mvidx++) {
-        Chess::push_move(moves[mvidx]);
-        float score = -nega_max(depth - 1, nodes, -beta, -alpha, test);
-        Chess::unmake_move(1);
+    move best = 0;
+    bool any_moves = false;
+    for (move mv = picker.next(); mv; mv = picker.next()) {
+        any_moves = true;
+        bool quiet = !picker.gen.is_capture(mv);
+        // checks are searched one ply deeper, up to the killer table's ply limit
+        int extension = ply < MAX_SEARCH_PLY - 1 && picker.gen.gives_check(mv);
+        Undo undo = ch.do_move(mv);
+        float score = -nega_max(depth - 1 + extension, nodes, -beta, -alpha, test);
+        ch.undo_move(mv, undo);
         if (score >= beta) {
-            TTable::add_item(ch.zhash, depth, Entry::FLAG_BETA, beta);
+            // remember quiet refutations for sibling nodes
+            if (quiet && killers[ply][0] != mv) {
+                killers[ply][1] = killers[ply][0];
+                killers[ply][0] = mv;
+            }
+            TTable::add_item(ch.zhash, depth, Entry::FLAG_BETA, beta, mv);
             return beta;
         }
+        best = score > alpha ? mv : best;
         alpha = score > alpha ? score : alpha;
     }
+
+    // check for mate
+    if (!any_moves)
+        return eval(depth);
     TTable::add_item(ch.zhash, depth, best ? Entry::FLAG_EXACT : Entry::FLAG_ALPHA, alpha, best);
     return alpha;
 }
@@ -120,12 +131,10 @@ float Player::nega_max(int depth, U64& nodes, float alpha, float beta, bool test
  */
 float Player::quiescence_search(int depth, U64& nodes, float alpha, float beta, bool test) {
     Chess& ch = *Chess::state();
-    MoveGenerator mgen(ch);
-    move moves[MAXMOVES] {};
-    mgen.gen_moves(moves);
     float stand_pat = eval(depth, test);
     nodes++;
-    if (!moves[MAXMOVES - 1] || stand_pat >= beta)
+    // eval() scores mate and stalemate, which have no captures either
+    if (stand_pat >= beta)
         return stand_pat;
 
     // check for threefold repition
@@ -141,63 +150,56 @@ float Player::quiescence_search(int depth, U64& nodes, float alpha, float beta,
     Entry prev = TTable::probe(ch.zhash);
     // if the stored depth was >= remaining search depth, use that result
     if (prev.depth >= depth) {
-        TTable::hits++;
+        TTable::stats.hits++;
         if (prev.flag == Entry::FLAG_EXACT)
             return prev.score;
         else if (prev.flag == Entry::FLAG_ALPHA && prev.score <= alpha)
             return alpha; // max score of stored move is worse than alpha
         else if (prev.flag == Entry::FLAG_BETA && prev.score >= beta)
             return beta; // min score of stored move is better than beta
-        TTable::hits--;
+        TTable::stats.hits--;
     }
 
-    // prioritize searching previous best moves
-    if (prev.best) {
-        TTable::hits++;
-        int best_pos = 0;
-        while (moves[best_pos] != prev.best) best_pos++;
-        Move::arr_shift_right(moves, best_pos);
-    }
+    // the picker tries the previous best move before generating captures
+    // the stored move may be a quiet move from the main search, which is skipped
+    MovePicker picker(ch, prev.best);
+    if (picker.has_tt_move())
+        TTable::stats.hits++;
 
     // make captures until no captures remain, then eval
     alpha = stand_pat > alpha ? stand_pat : alpha;
     move best = 0;
-    for (int mvidx = 0; mvidx < moves[MAXMOVES - 1]; mvidx++) {
-        if (!BB::contains_square(ch.bb_occ, Move::end(moves[mvidx])) && Move::end(moves[mvidx]) != ch.ep_square)
-            continue;
+    for (move mv = picker.next(); mv; mv = picker.next()) {
         nodes++;
-        Chess::push_move(moves[mvidx]);
+        Undo undo = ch.do_move(mv);
         float score = -quiescence_search(depth - 1, nodes, -beta, -alpha, test);
-        Chess::unmake_move(1);
+        ch.undo_move(mv, undo);
 
         // move scored >= beta (fail-high)
         // failing high means there is a "best" move, even though we can't play it
         // really the move is just "good enough", since there could be a better move
         if (score >= beta) {
-            TTable::add_item(ch.zhash, depth, Entry::FLAG_BETA, beta, moves[mvidx]);
+            TTable::add_item(ch.zhash, depth, Entry::FLAG_BETA, beta, mv);
             return beta;
         }
-        best = score > alpha ? moves[mvidx] : best;
+        best = score > alpha ? mv : best;
         alpha = score > alpha ? score : alpha;
     }
     TTable::add_item(ch.zhash, depth, best ? Entry::FLAG_EXACT : Entry::FLAG_ALPHA, alpha, best);
     return alpha;
 }
 
-void Player::order_moves_by_piece(const move moves[MAXMOVES], move* ordered) const {
+void Player::order_moves_by_piece(const MoveList& moves, MoveList& ordered) const {
     Chess& ch = *Chess::state();
-    ordered[MAXMOVES] = {};
-    move hash_move = TTable::read(ch.zhash).best;
-    if (hash_move) {
-        ordered[ordered[MAXMOVES - 1]] = hash_move;
-        ordered[MAXMOVES - 1]++;
-    }
+    ordered.clear();
+    move hash_move = TTable::probe(ch.zhash).best;
+    if (hash_move)
+        ordered.add(hash_move);
     for (int piece = ch_cst::KING; piece >= ch_cst::PAWN; piece--)
-        for (int i = 0; i < moves[MAXMOVES - 1]; i++) {
-            if (!BB::contains_square(*ch.bb_piece[piece], Move::start(moves[i])) || moves[i] == hash_move)
+        for (move mv : moves) {
+            if (ch.piece_at(Move::start(mv)) != piece || mv == hash_move)
                 continue;
-            ordered[ordered[MAXMOVES - 1]] = moves[i];
-            ordered[MAXMOVES - 1]++;
+            ordered.add(mv);
         }
 }
 
@@ -211,11 +213,10 @@ void Player::order_moves_by_piece(const move moves[MAXMOVES], move* ordered) con
 float Player::eval(int mate_offset, bool test) const {
     Chess& ch = *Chess::state();
     MoveGenerator eval_gen(ch);
-    move moves[MAXMOVES] = {};
-    eval_gen.gen_moves(moves);
+    int move_count = eval_gen.count_moves();
 
     // is the game over/detect threefold repetition
-    if (!moves[MAXMOVES - 1] || ch.repetitions() >= 3) {
+    if (!move_count || ch.repetitions() >= 3) {
         // if it is a stalemate, return 0
         if (test) fmt::print("{}", eval_gen.in_check ? "Checkmate!\n" : "Game is a stalemate!\n");
         return eval_gen.in_check ? (-99.99f - mate_offset) : 0;
@@ -226,17 +227,11 @@ float Player::eval(int mate_offset, bool test) const {
     float middlegame_weight = BB::count_bits(ch.bb_occ) / var_endgame_weight;
     float score = eval_position(middlegame_weight);
 
-
-    // check op moves for mobility & king safety
-    MoveGenerator op_gen(Chess::state());
-    op_gen.gen_moves(moves);
-
     // TODO: completely unfuck king safety
-    // king safety score:
-    U64 attack_mask = eval_gen.op_attack_mask;
-    U64 op_attack_mask = op_gen.op_attack_mask;
-    float white_king_safety = king_safety(false, !ch.black_to_move ? op_attack_mask : attack_mask);
-    float black_king_safety = king_safety(true, ch.black_to_move ? op_attack_mask : attack_mask);
+    // king safety score, from both sides' attacks on the position
+    const AttackInfo& info = MoveGenerator::attack_info(ch, true);
+    float white_king_safety = king_safety(false, info.attacks[ch_cst::BLACK_INDEX]);
+    float black_king_safety = king_safety(true, info.attacks[ch_cst::WHITE_INDEX]);
     // score += white_king_safety;
     // score -= black_king_safety;
 
@@ -245,10 +240,9 @@ float Player::eval(int mate_offset, bool test) const {
 
     // TODO: This also needs unfucking
     // mobility score:
-    ch.black_to_move = !ch.black_to_move;
-    int net_mobility = moves[MAXMOVES-1];
-    net_mobility -= moves[MAXMOVES-1];
-    ch.black_to_move = !ch.black_to_move;
+    // both counts are of the side to move, so this nets to zero
+    int net_mobility = move_count;
+    net_mobility -= move_count;
 
     // mobility is worth less in the endgame
     float mobility_score = net_mobility * var_mobility_weight * middlegame_weight;
@@ -289,8 +283,8 @@ float Player::eval_piece(float middlegame_weight, int piece, bool is_black) cons
     U64 pieces = *Chess::state()->bb_color[is_black] & *Chess::state()->bb_piece[piece];
     int piece_value = var_piece_value[piece];
     while (pieces) {
-        // x & -x masks the LS1B
-        score += piece_value + PieceLocationTables::complex_read(piece, 63 - BB::lz_count(pieces & 0-pieces), middlegame_weight, is_black);
+        // square of the LS1B
+        score += piece_value + PieceLocationTables::complex_read(piece, BB::lsb(pieces), middlegame_weight, is_black);
         // now clear that LS1B
         pieces &= pieces - 1;
     }
@@ -299,7 +293,7 @@ float Player::eval_piece(float middlegame_weight, int piece, bool is_black) cons
 
 // returns the number of threatened squares around the king
 float Player::king_safety(bool is_black, U64 op_attack_mask) const {
-    Chess ch = *Chess::state();
+    Chess& ch = *Chess::state();
     // square around the king
     U64 kattacks = Compass::king_attacks[ch.find_king(is_black)]
     // squares attacked by op
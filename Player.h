@@ -6,8 +6,10 @@
 #include "PieceLocationTables.h"
 #include "SearchLogger.h"
 #include "MoveGenerator.h"
+#include "MovePicker.h"
 
 const int MOB_CONST = 4;
+const int MAX_SEARCH_PLY = 64;
 
 class Player
 {
@@ -21,13 +23,16 @@ public:
     float eval_position(float middlegame_weight) const;
     float eval_piece(float middlegame_weight, int piece, bool is_black) const;
     float king_safety(bool is_black, U64 op_attack_mask) const;
-    void order_moves_by_piece(const move moves[MAXMOVES], move* ordered) const;
+    void order_moves_by_piece(const MoveList& moves, MoveList& ordered) const;
     int best_piece() const;
 private:
     SearchLogger search_log;
     float var_endgame_weight = 32.0f;
     float var_mobility_weight;
     int var_piece_value[7] = { 0, 100, 280, 300, 500, 970, 9999 };
+    // two quiet moves per ply that caused beta cutoffs
+    move killers[MAX_SEARCH_PLY][2] = {};
+    int root_keys = 0;
 };
 
 #endif
@@ -1,8 +1,9 @@
 #include "SearchLogger.h"
+#include <fstream>
 
 const std::string SearchLogger::file_path() const {
     CreateDirectory("logs", NULL);
-    return "logs/" + name + "_" + SearchLogger::date_to_string() + ".txt";
+    return "logs/" + name + (dated ? "_" + SearchLogger::date_to_string() : "") + ".txt";
 }
 
 /*
@@ -14,6 +15,19 @@ void SearchLogger::write(std::string text) {
     out.print(text);
 }
 
+/*
+ * Read back everything written to the log file
+ * @return the lines of the log file
+ */
+std::vector<std::string> SearchLogger::read_lines() const {
+    std::vector<std::string> lines;
+    std::ifstream in(file_path());
+    std::string line;
+    while (std::getline(in, line))
+        lines.push_back(line);
+    return lines;
+}
+
 void SearchLogger::log_position(std::string mv_txt) {
     buffer += ", " + mv_txt;
     write(buffer);
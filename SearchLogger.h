@@ -6,6 +6,7 @@
 #include <string>
 #include <iostream>
 #include <ostream>
+#include <vector>
 #include <windows.h>
 #include "Move.h"
 #include "Compass.h"
@@ -20,17 +21,21 @@ public:
             fmt::file::WRONLY | fmt::file::CREATE | fmt::file::APPEND)) {}
     inline SearchLogger(std::string str, int d) : name(str), depth(d), out(fmt::output_file(file_path(),
             fmt::file::WRONLY | fmt::file::CREATE | fmt::file::APPEND)) {}
-    inline SearchLogger(std::string str, int d, int params) : name(str), depth(d), out(fmt::output_file(file_path(), params)) {}
+    inline SearchLogger(std::string str, int d, int params, bool date = true) : name(str), depth(d), dated(date),
+            out(fmt::output_file(file_path(), params)) {}
     inline ~SearchLogger() { out.close(); }
     const std::string file_path() const;
     void write(std::string text);
     void log_position(std::string mv_text);
+    std::vector<std::string> read_lines() const;
     static std::string date_to_string();
     static std::string time_to_string();
     int depth;
     std::string buffer = "";
 private:
     std::string name;
+    // dated logs start a new file each day
+    bool dated = true;
     fmt::ostream out;
 };
 
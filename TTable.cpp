@@ -1,92 +1,250 @@
 #include "TTable.h"
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
 
-MyRNG TTable::rng;
-std::uniform_int_distribution<U64> TTable::U64_dist;
-U64 TTable::is_black_turn, TTable::hits, TTable::collisions, TTable::writes;
-U64 TTable::sq_color_type_64x2x6[64][2][6];
-// [white, black][king, queen]
-U64 TTable::castle_rights_wb_kq[2][2];
-U64 TTable::ep_file[8];
-Entry TTable::table[TTable::DEFAULT_SIZE];
-
-TTable::TTable() {
-    hits = 0;
-    collisions = 0;
-    writes = 0;
-    // e.g. keep one global instance (per thread)
-    rng.seed(SEED_VAL);
-    is_black_turn = U64_dist(rng);
-    castle_rights_wb_kq[ch_cst::WHITE_INDEX][0] = U64_dist(rng);
-    castle_rights_wb_kq[ch_cst::WHITE_INDEX][1] = U64_dist(rng);
-    castle_rights_wb_kq[ch_cst::BLACK_INDEX][0] = U64_dist(rng);
-    castle_rights_wb_kq[ch_cst::BLACK_INDEX][1] = U64_dist(rng);
-    for (int file = 0; file < 8; file++)
-        ep_file[file] = U64_dist(rng);
-    for (int sq = 0; sq < 64; sq++)
-        for (int type = 0; type < 6; type++)
-            for (int color = 0; color < 2; color++)
-                sq_color_type_64x2x6[sq][color][type] = U64_dist(rng);
+thread_local ThreadStats TTable::stats;
+std::atomic<uint8_t> TTable::generation{0};
+Bucket* TTable::table = nullptr;
+U64 TTable::bucket_count = 0;
+U64 TTable::mask = 0;
+TTable::Pages TTable::pages = TTable::PAGES_NONE;
+
+/*
+ * Method to allocate the table, emptying it.
+ * On Linux the table is backed by explicit huge pages when the system
+ * has them reserved, otherwise by 2 MB aligned memory marked for
+ * transparent huge pages, so one TLB entry covers 32768 buckets.
+ * @param mb the table size in megabytes,
+ *        rounded down to a power of two number of buckets
+ */
+void TTable::resize(int mb) {
+    U64 buckets = 1;
+    U64 max_buckets = ((U64) (mb > 0 ? mb : 1) << 20) / sizeof(Bucket);
+    while (buckets * 2 <= max_buckets)
+        buckets *= 2;
+    free_table();
+    size_t bytes = buckets * sizeof(Bucket);
+
+#ifdef __linux__
+    const size_t HUGE_PAGE = 2 << 20;
+    void* mem = MAP_FAILED;
+    if (bytes % HUGE_PAGE == 0)
+        mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED) {
+        table = (Bucket*) mem;
+        pages = PAGES_HUGE;
+    } else {
+        // aligned_alloc wants a multiple of the alignment
+        table = (Bucket*) std::aligned_alloc(HUGE_PAGE, (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE);
+        pages = madvise(table, bytes, MADV_HUGEPAGE) ? PAGES_NORMAL : PAGES_TRANSPARENT_HUGE;
+    }
+#elif defined(_MSC_VER)
+    table = (Bucket*) _aligned_malloc(bytes, sizeof(Bucket));
+    pages = PAGES_NORMAL;
+#else
+    table = (Bucket*) std::aligned_alloc(sizeof(Bucket), bytes);
+    pages = PAGES_NORMAL;
+#endif
+    if (!table) {
+        fmt::print("Could not allocate a {} MB transposition table!\n", bytes >> 20);
+        std::exit(1);
+    }
+
+    bucket_count = buckets;
+    mask = buckets - 1;
+    for (U64 idx = 0; idx < bucket_count; idx++)
+        new (table + idx) Bucket();
+    reset_stats();
+}
+
+void TTable::free_table() {
+    if (!table)
+        return;
+#ifdef __linux__
+    if (pages == PAGES_HUGE)
+        munmap(table, bucket_count * sizeof(Bucket));
+    else
+        std::free(table);
+#elif defined(_MSC_VER)
+    _aligned_free(table);
+#else
+    std::free(table);
+#endif
+    table = nullptr;
+    pages = PAGES_NONE;
+}
+
+size_t TTable::size_mb() {
+    return bucket_count * sizeof(Bucket) >> 20;
+}
+
+U64 TTable::entry_count() {
+    return bucket_count * Bucket::SIZE;
+}
+
+/*
+ * @return the kind of pages backing the table
+ */
+std::string TTable::page_mode() {
+    switch (pages) {
+    case PAGES_HUGE:
+        return "huge pages";
+    case PAGES_TRANSPARENT_HUGE:
+        return "transparent huge pages";
+    case PAGES_NORMAL:
+        return "normal pages";
+    default:
+        return "unallocated";
+    }
+}
+
+/*
+ * Method to start a new search generation.
+ * Entries from earlier searches stay usable,
+ * but are the first to go when a bucket fills up.
+ */
+void TTable::new_search() {
+    generation = (generation + 1) % GENERATIONS;
+}
+
+// statistics of running threads, and what finished threads counted
+static std::mutex stats_lock;
+static std::vector<ThreadStats*> live_stats;
+static TTStats retired_stats;
+
+ThreadStats::ThreadStats() {
+    std::lock_guard<std::mutex> lock(stats_lock);
+    live_stats.push_back(this);
+}
+
+ThreadStats::~ThreadStats() {
+    std::lock_guard<std::mutex> lock(stats_lock);
+    retired_stats.hits += hits.get();
+    retired_stats.collisions += collisions.get();
+    retired_stats.writes += writes.get();
+    live_stats.erase(std::find(live_stats.begin(), live_stats.end(), this));
 }
 
 /*
- * Method to empty the transposition table.
+ * Method to add up the statistics of every thread that used the table
+ * @return the merged counts
  */
-void TTable::clear() {
-    writes = 0;
-    hits = 0;
-    for (int idx = 0; idx < DEFAULT_SIZE; idx++) {
-        table[idx].key = 0;
-        table[idx].depth = -100;
-        table[idx].flag = 0;
-        table[idx].score = 0.0f;
-        table[idx].best = 0;
+TTStats TTable::total_stats() {
+    std::lock_guard<std::mutex> lock(stats_lock);
+    TTStats total = retired_stats;
+    for (const ThreadStats* thread : live_stats) {
+        total.hits += thread->hits.get();
+        total.collisions += thread->collisions.get();
+        total.writes += thread->writes.get();
+    }
+    return total;
+}
+
+void TTable::reset_stats() {
+    std::lock_guard<std::mutex> lock(stats_lock);
+    retired_stats = TTStats();
+    for (ThreadStats* thread : live_stats) {
+        thread->hits.value = 0;
+        thread->collisions.value = 0;
+        thread->writes.value = 0;
     }
-    fmt::print("TTable cleared!\n");
 }
 
 float TTable::fill_test() {
-    return (float) writes / DEFAULT_SIZE;
+    return (float) total_stats().writes / entry_count();
 }
 
 /*
  * Method to calculate how full the transposition table is
- * @return the percent of Entries in the t-table that have been written too
+ * @return the percent of Entries in the t-table written by the current search
  */
 float TTable::fill_ratio() {
     float num_elements = 0;
-    for (Entry e : table)
-        num_elements += e.flag > 0;
-    return num_elements / DEFAULT_SIZE;
-}
-
-int TTable::hash_index(U64 key) {
-    return std::abs((int) (key % DEFAULT_SIZE));
+    for (U64 idx = 0; idx < bucket_count; idx++)
+        for (const Slot& slot : table[idx].slots) {
+            Entry entry = Entry::unpack(0, slot.load());
+            num_elements += entry.flag && entry.generation == generation;
+        }
+    return num_elements / entry_count();
 }
 
+/*
+ * Method to store a search result in the bucket of its key.
+ * The key's own entry is updated in place, otherwise the result
+ * goes to an empty entry or replaces the one worth least:
+ * shallow entries from old searches go first.
+ * A shallower result for the same key keeps the deeper one.
+ * @param key zobrist hash of the position
+ * @param depth the remaining depth the position was searched to
+ * @param flag whether score is exact or an alpha or beta bound
+ * @param score the search result
+ * @param mv the best move found, 0 if none
+ */
 void TTable::add_item(U64 key, int8_t depth, uint8_t flag, float score, move mv) {
-    if ((float) writes / DEFAULT_SIZE > 0.7)
-        clear();
-    int index = hash_index(key);
-    // if hash_index(key) is full, find the next empty index
-    while (read(index).flag && read(index).key != key)
-        index++;
-    // if the position is already searched to a greater depth, do not write
-    if (read(index).depth > depth)
-        return;
+    Slot* slots = table[hash_index(key)].slots;
+    uint8_t gen = generation.load(std::memory_order_relaxed);
+    Slot* replace = slots;
+    int replace_worth = 1 << 10;
+    bool replace_full = false;
+    for (int i = 0; i < Bucket::SIZE; i++) {
+        U64 word = slots[i].load();
+        Entry entry = Entry::unpack(key, word);
+        if (Entry::matches(key, word)) {
+            // if the position is already searched to a greater depth, do not write
+            if (entry.depth > depth) {
+                entry.generation = gen;
+                slots[i].store(entry);
+                return;
+            }
+            // keep the old best move when this search found none
+            slots[i].store(Entry(key, depth, flag, score, mv ? mv : entry.best, gen));
+            stats.writes++;
+            return;
+        }
+        // every search of age costs an entry as much as 8 ply of depth
+        int age = (GENERATIONS + gen - entry.generation) % GENERATIONS;
+        int worth = entry.flag ? entry.depth - 8 * age : -(1 << 10);
+        if (worth < replace_worth) {
+            replace = slots + i;
+            replace_worth = worth;
+            replace_full = entry.flag;
+        }
+    }
     // record a collision
-    if (index != hash_index(key))
-        collisions++;
-    table[index] = Entry(key, depth, flag, score, mv);
-    writes++;
+    if (replace_full)
+        stats.collisions++;
+    replace->store(Entry(key, depth, flag, score, mv, gen));
+    stats.writes++;
 }
 
+/*
+ * Method to look up a position,
+ * a hit carries the entry into the current search
+ * @param key zobrist hash of the position
+ * @return the stored entry, or an empty Entry if there is none
+ */
 Entry TTable::probe(U64 key) {
-    int index = hash_index(key);
-    while (read(index).flag && read(index).key != key)
-        index++;
-    return read(index);
-}
-
-Entry TTable::read(U64 key) {
-    return table[hash_index(key)];
+    Slot* slots = table[hash_index(key)].slots;
+    uint8_t gen = generation.load(std::memory_order_relaxed);
+    for (int i = 0; i < Bucket::SIZE; i++) {
+        U64 word = slots[i].load();
+        if (!Entry::matches(key, word))
+            continue;
+        Entry entry = Entry::unpack(key, word);
+        if (entry.generation != gen) {
+            entry.generation = gen;
+            slots[i].store(entry);
+        }
+        return entry;
+    }
+    return Entry();
 }
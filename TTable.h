@@ -4,23 +4,101 @@
 #include "Move.h"
 #include "Compass.h"
 #include "fmt/include/fmt/format.h"
-#include <random>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 
-typedef std::mt19937_64 MyRNG;
+/*
+ * xorshift64* generator, small enough for the compiler
+ * to run while it builds the Zobrist keys
+ */
+struct PRNG {
+    U64 state;
+    constexpr PRNG(U64 seed) : state(seed) {}
+    constexpr U64 next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ull;
+    }
+};
+
+// every random bitstring Chess::hash() combines
+struct ZobristKeys {
+    U64 is_black_turn;
+    U64 castle_rights_wb_kq[2][2];
+    U64 ep_file[8];
+    U64 sq_color_type_64x2x6[64][2][6];
+};
 
+/*
+ * Draw every Zobrist key from one generator at compile time
+ * @param seed any nonzero seed
+ * @return the keys in the order they are drawn
+ */
+constexpr ZobristKeys zobrist_keys(U64 seed) {
+    PRNG rng(seed);
+    ZobristKeys keys{};
+    keys.is_black_turn = rng.next();
+    for (int color = 0; color < 2; color++)
+        for (int side = 0; side < 2; side++)
+            keys.castle_rights_wb_kq[color][side] = rng.next();
+    for (int file = 0; file < 8; file++)
+        keys.ep_file[file] = rng.next();
+    for (int sq = 0; sq < 64; sq++)
+        for (int type = 0; type < 6; type++)
+            for (int color = 0; color < 2; color++)
+                keys.sq_color_type_64x2x6[sq][color][type] = rng.next();
+    return keys;
+}
+
+/*
+ * One search result. In the table it is packed into a single
+ * 64-bit word, see pack()
+ */
 struct Entry {
-    Entry() : key(0), depth(-100), flag(0), score(0.0f), best(0) {}
-    Entry(U64 k, int8_t d, uint8_t f, float score) : key(k), depth(d), flag(f), score(score), best(0) {}
-    Entry(U64 k, int8_t d, uint8_t f, float score, move m) : key(k), depth(d), flag(f), score(score), best(m) {}
+    Entry() : key(0), score(0.0f), best(0), depth(-100), flag(0), generation(0) {}
+    Entry(U64 k, int8_t d, uint8_t f, float score, move m = 0, uint8_t gen = 0)
+        : key(k), score(score), best(m), depth(d), flag(f), generation(gen) {}
     U64 key;
-    int8_t depth;
-    uint8_t flag;
     float score;
     move best;
+    int8_t depth;
+    uint8_t flag : 2;
+    // the search that last wrote or found this entry, mod 64
+    uint8_t generation : 6;
     inline std::string to_string() const
-    { return fmt::format("key: {} depth: {} flag: {} score: {} best: {}",
-        key, depth, flag, score, best); };
+    { return fmt::format("key: {} depth: {} flag: {} gen: {} score: {} best: {}",
+        key, depth, (int) flag, (int) generation, score, best); };
+
+    // the key bits kept in the table, the bucket index uses the low ones
+    static inline U64 tag(U64 key) { return key >> 48; }
+    // scores are kept in centipawns
+    static const int SCORE_SCALE = 100;
+
+    /*
+     * @return the entry in one word: key tag bits 0-15, centipawn score 16-31,
+     *      best 32-47, depth 48-55, flag 56-57, generation 58-63
+     */
+    inline U64 pack() const {
+        int cp = (int) (score * SCORE_SCALE + (score < 0 ? -0.5f : 0.5f));
+        cp = cp < INT16_MIN ? INT16_MIN : cp > INT16_MAX ? INT16_MAX : cp;
+        return tag(key) | (U64) (uint16_t) cp << 16 | (U64) best << 32
+             | (U64) (uint8_t) depth << 48 | (U64) flag << 56 | (U64) generation << 58;
+    }
+    /*
+     * @param key the full key the word was found under
+     * @param word a packed entry
+     */
+    static inline Entry unpack(U64 key, U64 word) {
+        float score = (float) (int16_t) (word >> 16) / SCORE_SCALE;
+        return Entry(key, (int8_t) (word >> 48), (word >> 56) & 3, score, (move) (word >> 32), word >> 58);
+    }
+    // @return true if word holds a result for key
+    static inline bool matches(U64 key, U64 word) {
+        return (word & 0xffff) == tag(key) && (word >> 56 & 3);
+    }
+
     // eval is exact value (all moves were searched)
     static const uint8_t FLAG_EXACT = 1;
     // eval is < alpha value
@@ -29,39 +107,95 @@ struct Entry {
     static const uint8_t FLAG_BETA = 3;
 };
 
+/*
+ * An entry as stored, shared by every search thread without a lock.
+ * The whole entry is one atomic word, so it can never be read torn.
+ */
+struct Slot {
+    std::atomic<U64> word{0};
+    inline U64 load() const { return word.load(std::memory_order_relaxed); }
+    inline void store(const Entry& entry) { word.store(entry.pack(), std::memory_order_relaxed); }
+};
+
+/*
+ * The entries one key can live in, a single 64 byte cache line
+ */
+struct alignas(64) Bucket {
+    static const int SIZE = 8;
+    Slot slots[SIZE];
+};
+static_assert(sizeof(Bucket) == 64, "a bucket should fill exactly one cache line");
+static_assert(std::atomic<U64>::is_always_lock_free, "table words must be lock free");
+
+/*
+ * A counter only its own thread increments, readable from any thread.
+ * Relaxed load and store, so counting takes no locked instruction.
+ */
+struct StatCounter {
+    std::atomic<U64> value{0};
+    inline void operator++(int) { value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+    inline void operator--(int) { value.store(value.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed); }
+    inline U64 get() const { return value.load(std::memory_order_relaxed); }
+};
+
+/*
+ * One thread's table statistics. They register themselves so
+ * TTable::total_stats() can add them up, and fold into the
+ * retired totals when their thread ends.
+ */
+struct ThreadStats {
+    ThreadStats();
+    ~ThreadStats();
+    StatCounter hits, collisions, writes;
+};
+
+// every thread's statistics added up
+struct TTStats {
+    U64 hits = 0, collisions = 0, writes = 0;
+};
+
 class TTable {
 public:
-    TTable();
-    // smaller table cleared every move
-    // static const int DEFAULT_SIZE = 5595979;
-    static const int DEFAULT_SIZE = 35000011;
-    static const U64 SEED_VAL = 15375420585056461361ull;
-
-    // the Mersenne Twister with a popular choice of parameters
-    static MyRNG rng;
-    static std::uniform_int_distribution<U64> U64_dist;
+    static const int DEFAULT_MB = 256;
+    static constexpr U64 SEED_VAL = 15375420585056461361ull;
+    static constexpr ZobristKeys ZOBRIST = zobrist_keys(SEED_VAL);
 
     // array of random bitstrings for each piece at each square
-    static U64 sq_color_type_64x2x6[64][2][6];
+    static constexpr auto& sq_color_type_64x2x6 = ZOBRIST.sq_color_type_64x2x6;
 
     // Kingside: 0, Queenside: 1
-    static U64 castle_rights_wb_kq[2][2];
+    static constexpr auto& castle_rights_wb_kq = ZOBRIST.castle_rights_wb_kq;
 
     // file 0 - 7 of ep square
-    static U64 ep_file[8];
+    static constexpr auto& ep_file = ZOBRIST.ep_file;
 
-    static U64 is_black_turn;
-    static U64 hits, collisions, writes;
+    static constexpr const U64& is_black_turn = ZOBRIST.is_black_turn;
+    // this thread's counts, see total_stats()
+    static thread_local ThreadStats stats;
+    // bumped once per search, entries from older searches are replaced first
+    static std::atomic<uint8_t> generation;
+    static const int GENERATIONS = 64;
 
-    static void clear();
+    static void resize(int mb);
+    static size_t size_mb();
+    static U64 entry_count();
+    static std::string page_mode();
+    static void new_search();
+    static TTStats total_stats();
     static float fill_test();
     static float fill_ratio();
-    static int hash_index(U64 key);
+    static inline U64 hash_index(U64 key) { return key & mask; }
     static void add_item(U64 key, int8_t depth, uint8_t flag, float score, move mv = 0);
-    static Entry read(U64 key);
     static Entry probe(U64 key);
 private:
-    static Entry table[DEFAULT_SIZE];
+    // how the table memory was allocated, which decides how it is freed
+    enum Pages { PAGES_NONE, PAGES_NORMAL, PAGES_TRANSPARENT_HUGE, PAGES_HUGE };
+    static void free_table();
+    static void reset_stats();
+    static Bucket* table;
+    static U64 bucket_count;
+    static U64 mask;
+    static Pages pages;
 };
 
 #endif
@@ -1,8 +1,20 @@
 #include "Chess.h"
 #include "Player.h"
+#include "PerftPool.h"
+#include "PerftTable.h"
+#include "PerftSuite.h"
+#include "Bench.h"
+#include <map>
+#include <cstdlib>
+#include <climits>
 
 U64 perft_root(int depth, int log_depth = 1);
 U64 perft(int depth, U64& nodes);
+U64 hperft_root(int depth, int table_mb);
+U64 hperft(int depth, U64& nodes, PerftTable& table);
+U64 rperft_root(int depth, int split_ply);
+U64 rperft(int depth, int split_ply, std::string path, SearchLogger& checkpoint,
+    std::map<std::string, U64>& finished, U64& nodes);
 U64 eperft_root(int depth);
 U64 eperft(int depth, U64& nodes);
 
@@ -18,8 +30,16 @@ const std::string HELP_STRINGS[] = {
     "\tSearches deeper than four ply may take extemely long.\n",
     "perft x: \tCount all moves at depth x. Allows any depth > -1.\n",
     "\tSearches deeper than six may take extremely long.\n",
+    "pperft x: \tCount all moves at depth x on every core.\n",
+    "hperft x y: \tCount all moves at depth x with a y MB leaf count cache.\n",
+    "rperft x y: \tCount all moves at depth x, checkpointing every subtree y ply deep.\n",
+    "\tRestarting the same count skips the finished subtrees.\n",
+    "suite f: \tRun the perft suite in EPD file f on every core.\n",
     "eperft x: \tEval all positions at depth x. Allows any depth > -1.\n",
     "\tSearches deeper than six may take extremely long.\n",
+    "bench x: \tRun benchmark x, one of: stack make sliders bits tt search.\n",
+    "hash x: \tResize the transposition table to x MB, emptying it.\n",
+    "\tStart with --hash x to choose the size up front.\n",
     "help: \tDisplays this message.\n"
 };
 
@@ -33,8 +53,36 @@ const std::string PERFT_RESULTS[16] = {
 Player engine(1.0f);
 
 int main(int arg0, char** args) {
+    // refuse to run instructions this CPU doesn't have
+    std::string missing = BB::missing_cpu_features();
+    if (missing != "") {
+        fmt::print("This build needs {}which this CPU lacks. Rebuild without USE_BMI or USE_PEXT.\n", missing);
+        return 1;
+    }
     Compass();
-    TTable();
+
+    // options come before any command: --hash <MB>
+    int argi = 1;
+    int hash_mb = TTable::DEFAULT_MB;
+    if (argi + 1 < arg0 && std::string(args[argi]) == "--hash") {
+        char* end;
+        long mb = std::strtol(args[argi + 1], &end, 10);
+        if (end == args[argi + 1] || *end != '\0' || mb < 1 || mb > INT_MAX) {
+            fmt::print("--hash needs a positive table size in MB.\n"
+                "Usage: {} [--hash <MB>] [suite [file]]\n", args[0]);
+            return 1;
+        }
+        hash_mb = (int) mb;
+        argi += 2;
+    }
+
+    // run the perft suite without starting a game
+    if (arg0 > argi && std::string(args[argi]) == "suite")
+        return PerftSuite(arg0 > argi + 1 ? args[argi + 1] : "perft_suite.epd").run() ? 0 : 1;
+
+    TTable::resize(hash_mb);
+    fmt::print("Transposition table: {} MB, {} entries, {}\n",
+        TTable::size_mb(), TTable::entry_count(), TTable::page_mode());
 
     enum human_index {
         AWAIT_INPUT = -1,
@@ -51,8 +99,8 @@ int main(int arg0, char** args) {
         std::cin >> in;
     human = human_index(in);
 
-    // Chess::stack.top->pos = new Chess (ch_cst::TEST_FEN);
-    Chess::stack.top->pos = new Chess (ch_cst::START_FEN);
+    // Chess::stack.reset(Chess(ch_cst::TEST_FEN));
+    Chess::stack.reset(Chess(ch_cst::START_FEN));
 
     // Player low_mobility(0.80f), high_mobility(1.20f);
     // Player players[2] = { low_mobility, high_mobility };
@@ -68,26 +116,27 @@ int main(int arg0, char** args) {
     while (playing) {
         Chess& ch = *Chess::state();
         MoveGenerator mgen(ch);
-        move moves[MAXMOVES] = {};
+        MoveList moves;
         mgen.gen_moves(moves);
         // print ui
         if (print_ui) {
             fmt::print("\n");
             ch.print_board(true);
             fmt::print("fen: {}\nhash: {:0>16X}\nwrites: {} hits: {} fill: %{:2.2f} fill2: %{:2.2f}\n",
-                ch.fen(), ch.zhash, TTable::writes, TTable::hits, TTable::fill_ratio() * 100, TTable::fill_test() * 100);
+                ch.fen(), ch.zhash, TTable::total_stats().writes, TTable::total_stats().hits,
+                TTable::fill_ratio() * 100, TTable::fill_test() * 100);
             // print position eval
             engine.eval(0, true);
             // print search information
             fmt::print("nodes: {:<10d} n/s: {:0.3f} time: {:0.3f}s\n",
                     nodes, game_timer.elapsed() >= 0.01f ? nodes / game_timer.elapsed() : 0.0f, game_timer.elapsed());
             // print game information
-            if (Chess::stack.top->next)
-                fmt::print("{}{} {}\n", Chess::stack.top->next->pos->fullmoves, ch.black_to_move ? ". " : ".. ", last_move);
+            if (!Chess::stack.is_empty())
+                fmt::print("{}{} {}\n", Chess::stack.at(Chess::stack.ply - 1)->fullmoves, ch.black_to_move ? ". " : ".. ", last_move);
             fmt::print("reps: {} halfmoves: {}\n", ch.repetitions(), ch.halfmoves);
             // print legal moves if it's a human player's turn
             if (!ch.black_to_move && human == PLAY_WHITE || ch.black_to_move && human == PLAY_BLACK || human == PLAY_FREE)
-                for (int i = 0; i < moves[MAXMOVES - 1]; i++)
+                for (int i = 0; i < moves.size(); i++)
                     fmt::print("{} ", MoveGenerator::move_san(moves[i]));
             // print player to move
             fmt::print("\n{} to move: ", ch.black_to_move ? "Black" : "White");
@@ -142,6 +191,7 @@ int main(int arg0, char** args) {
             // null move - skip your turn. highly illegal!
             ch.black_to_move = !ch.black_to_move;
             ch.zhash ^= TTable::is_black_turn;
+            ch.attack_info.clear();
         } else if (input == "aim") {
             int depth = 0;
             while (depth < 1 || depth > 9)
@@ -156,14 +206,51 @@ int main(int arg0, char** args) {
             while (depth < 0)
                 std::cin >> depth;
             perft_root(depth, 1);
+        } else if (input == "pperft") {
+            int depth = -1;
+            while (depth < 0)
+                std::cin >> depth;
+            PerftPool pool;
+            pool.run(depth);
+        } else if (input == "hperft") {
+            int depth = -1;
+            while (depth < 0)
+                std::cin >> depth;
+            int table_mb = 0;
+            while (table_mb < 1)
+                std::cin >> table_mb;
+            hperft_root(depth, table_mb);
+        } else if (input == "rperft") {
+            int depth = -1;
+            while (depth < 0)
+                std::cin >> depth;
+            int split_ply = 0;
+            while (split_ply < 1 || split_ply > 2)
+                std::cin >> split_ply;
+            rperft_root(depth, split_ply);
+        } else if (input == "suite") {
+            std::string path;
+            std::cin >> path;
+            PerftSuite(path).run();
+        } else if (input == "bench") {
+            std::string name;
+            std::cin >> name;
+            Bench::run(name);
         } else if (input == "eperft") {
             int depth = -1;
             while (depth < 0)
                 std::cin >> depth;
             eperft_root(depth);
+        } else if (input == "hash") {
+            int table_mb = 0;
+            while (table_mb < 1)
+                std::cin >> table_mb;
+            TTable::resize(table_mb);
+            fmt::print("Transposition table: {} MB, {} entries, {}\n",
+                TTable::size_mb(), TTable::entry_count(), TTable::page_mode());
         } else if (input == "end") {
             playing = false;
-        } else for (int i = 0; i < moves[MAXMOVES - 1]; i++) {
+        } else for (int i = 0; i < moves.size(); i++) {
             if (input != MoveGenerator::move_san(moves[i]))
                 continue;
             last_move = MoveGenerator::move_san(moves[i]);
@@ -203,17 +290,17 @@ U64 perft_root(int depth, int log_depth) {
             depth, SearchLogger::time_to_string()));
     Timer perft_timer;
     MoveGenerator perft_gen(ch);
-    move moves[MAXMOVES] = {};
+    MoveList moves;
     perft_gen.gen_moves(moves);
 
     // main test loop
     if (!depth)
         leaf_nodes = 1;
-    else for (int mvidx = 0; mvidx < moves[MAXMOVES - 1]; mvidx++) {
+    else for (int mvidx = 0; mvidx < moves.size(); mvidx++) {
         move mv = moves[mvidx];
-        std::cout << fmt::format("{}/{}:\t{} ", mvidx + 1, moves[MAXMOVES - 1], Move::to_string(mv));
+        std::cout << fmt::format("{}/{}:\t{} ", mvidx + 1, moves.size(), Move::to_string(mv));
         if (depth > perft_log.depth)
-            perft_log.buffer = fmt::format("{}/{}:\t{} ", mvidx + 1, moves[MAXMOVES - 1], Move::to_string(mv));
+            perft_log.buffer = fmt::format("{}/{}:\t{} ", mvidx + 1, moves.size(), Move::to_string(mv));
         Chess::push_move(mv);
         nodes++;
         U64 i = perft(depth - 1, nodes);
@@ -263,19 +350,25 @@ U64 perft_root(int depth, int log_depth) {
 U64 perft(int depth, U64& nodes) {
     if (!depth)
         return 1;
-    Chess ch = *Chess::state();
+    Chess& ch = *Chess::state();
     U64 leaf_nodes = 0;
     MoveGenerator perft_gen(ch);
-    move moves[MAXMOVES] = {};
+    // bulk-count the frontier when no moves need to be logged
+    if (depth == 1 && depth <= perft_log.depth) {
+        leaf_nodes = perft_gen.count_moves();
+        nodes += leaf_nodes;
+        return leaf_nodes;
+    }
+    MoveList moves;
     perft_gen.gen_moves(moves);
-    for (int mvidx = 0; mvidx < moves[MAXMOVES - 1]; mvidx++) {
+    for (int mvidx = 0; mvidx < moves.size(); mvidx++) {
         if (depth > perft_log.depth)
             perft_log.buffer += fmt::format(" {}", MoveGenerator::move_san(moves[mvidx]));
-        Chess::push_move(moves[mvidx]);
+        Undo undo = ch.do_move(moves[mvidx]);
         nodes++;
         U64 i = perft(depth - 1, nodes);
         leaf_nodes += i;
-        ch.unmake_move(1);
+        ch.undo_move(moves[mvidx], undo);
         if (depth == 1 + perft_log.depth)
             perft_log.write(fmt::format("{} {}\n", perft_log.buffer, std::to_string(i)));
         if (depth > perft_log.depth)
@@ -284,6 +377,142 @@ U64 perft(int depth, U64& nodes) {
     return leaf_nodes;
 }
 
+/*
+ * Hashed PERformance Test root method
+ * Leaf counts of subtrees are cached by zhash and remaining depth
+ * @param depth number of ply to search
+ * @param table_mb size of the leaf count cache in megabytes
+ */
+U64 hperft_root(int depth, int table_mb) {
+    PerftTable table(table_mb);
+    U64 nodes = 0;
+    fmt::print("Starting hashed perft({}) with a {} MB table at {}\n",
+        depth, table.size_mb(), SearchLogger::time_to_string());
+    Timer perft_timer;
+    U64 leaf_nodes = hperft(depth, nodes, table);
+    double elapsed = perft_timer.elapsed();
+
+    // test finished, print results
+    fmt::print("{}: search finished in {}s at {:.0f} nodes/s\n{} leaf nodes found at depth {}.\n",
+        SearchLogger::time_to_string(), elapsed, elapsed >= 0.001 ? nodes / elapsed : (double) nodes,
+        leaf_nodes, depth);
+    fmt::print("table probes: {} hits: {} hit rate: %{:2.2f}\n",
+        table.probes, table.hits, table.hit_rate() * 100);
+    if (Chess::state()->fen() == ch_cst::START_FEN && depth < 16)
+        fmt::print("{} nodes expected. {}\n", PERFT_RESULTS[depth],
+            leaf_nodes == std::stoull(PERFT_RESULTS[depth]) ? "Nice!" : "Uh oh!");
+    return leaf_nodes;
+}
+
+/*
+ * Hashed PERformance Test recursion method
+ * @param depth number of ply remaining in the search
+ * @param nodes U64& to count the number of positions searched
+ * @param table the leaf count cache
+ */
+U64 hperft(int depth, U64& nodes, PerftTable& table) {
+    if (!depth)
+        return 1;
+    Chess& ch = *Chess::state();
+    U64 leaf_nodes = 0;
+    if (depth > 1 && table.probe(ch.zhash, depth, leaf_nodes))
+        return leaf_nodes;
+    MoveGenerator perft_gen(ch);
+    // bulk-count the frontier
+    if (depth == 1) {
+        leaf_nodes = perft_gen.count_moves();
+        nodes += leaf_nodes;
+        return leaf_nodes;
+    }
+    MoveList moves;
+    perft_gen.gen_moves(moves);
+    for (int mvidx = 0; mvidx < moves.size(); mvidx++) {
+        Undo undo = ch.do_move(moves[mvidx]);
+        nodes++;
+        leaf_nodes += hperft(depth - 1, nodes, table);
+        ch.undo_move(moves[mvidx], undo);
+    }
+    if (depth > 1)
+        table.store(ch.zhash, depth, leaf_nodes);
+    return leaf_nodes;
+}
+
+/*
+ * Resumable PERformance Test root method
+ * Every subtree split_ply moves deep is recorded in a checkpoint log
+ * once counted. Rerunning the same test reads the log back and skips
+ * the subtrees that are already finished. The log is named by the
+ * position's Zobrist key, so logs written by a build with other keys
+ * are not found and the test starts over.
+ * @param depth number of ply to search
+ * @param split_ply depth of the checkpointed subtrees, 1 or 2
+ */
+U64 rperft_root(int depth, int split_ply) {
+    Chess& ch = *Chess::state();
+    split_ply = split_ply < depth ? split_ply : depth;
+    SearchLogger checkpoint(fmt::format("perft_checkpoint_{:0>16X}_{}_{}", ch.zhash, depth, split_ply), 0,
+        fmt::file::WRONLY | fmt::file::CREATE | fmt::file::APPEND, false);
+
+    // each line of the checkpoint is "<moves> <leaf nodes>"
+    std::map<std::string, U64> finished;
+    for (std::string line : checkpoint.read_lines()) {
+        size_t split = line.find_last_of(' ');
+        if (split == std::string::npos || line.find_first_not_of("0123456789", split + 1) != std::string::npos)
+            continue;
+        finished[line.substr(0, split)] = std::stoull(line.substr(split + 1));
+    }
+    fmt::print("Starting resumable perft({}) at {}, {} subtrees already finished\ncheckpoint: {}\n",
+        depth, SearchLogger::time_to_string(), finished.size(), checkpoint.file_path());
+
+    U64 nodes = 0;
+    Timer perft_timer;
+    U64 leaf_nodes = rperft(depth, split_ply, "", checkpoint, finished, nodes);
+    double elapsed = perft_timer.elapsed();
+
+    // test finished, print results
+    fmt::print("{}: search finished in {}s at {:.0f} nodes/s\n{} leaf nodes found at depth {}.\n",
+        SearchLogger::time_to_string(), elapsed, elapsed >= 0.001 ? nodes / elapsed : (double) nodes,
+        leaf_nodes, depth);
+    if (ch.fen() == ch_cst::START_FEN && depth < 16)
+        fmt::print("{} nodes expected. {}\n", PERFT_RESULTS[depth],
+            std::to_string(leaf_nodes) == PERFT_RESULTS[depth] ? "Nice!" : "Uh oh!");
+    return leaf_nodes;
+}
+
+/*
+ * Resumable PERformance Test recursion method
+ * @param depth number of ply remaining in the search
+ * @param split_ply number of ply remaining until the checkpointed subtrees
+ * @param path the moves played so far
+ * @param checkpoint log of finished subtrees
+ * @param finished the subtrees read back from the checkpoint
+ * @param nodes U64& to count the number of positions searched
+ */
+U64 rperft(int depth, int split_ply, std::string path, SearchLogger& checkpoint,
+        std::map<std::string, U64>& finished, U64& nodes) {
+    if (!split_ply) {
+        auto done = finished.find(path);
+        if (done != finished.end())
+            return done->second;
+        U64 leaf_nodes = PerftPool::perft(depth, nodes);
+        checkpoint.write(fmt::format("{} {}\n", path, leaf_nodes));
+        fmt::print("{}: {} {}\n", SearchLogger::time_to_string(), path, leaf_nodes);
+        return leaf_nodes;
+    }
+    U64 leaf_nodes = 0;
+    MoveGenerator perft_gen(Chess::state());
+    MoveList moves;
+    perft_gen.gen_moves(moves);
+    for (int mvidx = 0; mvidx < moves.size(); mvidx++) {
+        Chess::push_move(moves[mvidx]);
+        nodes++;
+        leaf_nodes += rperft(depth - 1, split_ply - 1, path + (path.empty() ? "" : " ") + Move::to_string(moves[mvidx]),
+            checkpoint, finished, nodes);
+        Chess::unmake_move(1);
+    }
+    return leaf_nodes;
+}
+
 /*
  * Evaluation PERformance Test root method
  * @param chess the starting position to test
@@ -305,13 +534,13 @@ U64 eperft_root(int depth) {
     U64 nodes = 0;
     Timer eperft_timer;
     MoveGenerator eperft_gen(ch);
-    move moves[MAXMOVES] = {};
+    MoveList moves;
     eperft_gen.gen_moves(moves);
 
     // main test loop
     if (!depth)
         leaf_nodes = 1;
-    else for (int mvidx = 0; mvidx < moves[MAXMOVES - 1]; mvidx++)
+    else for (int mvidx = 0; mvidx < moves.size(); mvidx++)
     {
         Chess::push_move(moves[mvidx]);
         nodes++;
@@ -343,9 +572,9 @@ U64 eperft(int depth, U64& nodes) {
     }
     U64 leaf_nodes = 0;
     MoveGenerator eperft_gen(ch);
-    move moves[MAXMOVES] = {};
+    MoveList moves;
     eperft_gen.gen_moves(moves);
-    for (int mvidx = 0; mvidx < moves[MAXMOVES - 1]; mvidx++) {
+    for (int mvidx = 0; mvidx < moves.size(); mvidx++) {
         Chess::push_move(moves[mvidx]);
         nodes++;
         U64 i = eperft(depth - 1, nodes);